@@ -61,6 +61,14 @@ CREATE OR REPLACE FUNCTION get_prob(
   token UUID)
   RETURNS DOUBLE PRECISION AS
   'provsql','get_prob' LANGUAGE C;
+CREATE OR REPLACE FUNCTION set_scenario_probs(
+  scenario text, tokens UUID[], probs DOUBLE PRECISION[])
+  RETURNS void AS
+  'provsql','set_scenario_probs' LANGUAGE C;
+CREATE OR REPLACE FUNCTION drop_scenario(
+  scenario text)
+  RETURNS void AS
+  'provsql','drop_scenario' LANGUAGE C;
 CREATE OR REPLACE FUNCTION set_infos(
   token UUID, info1 INT, info2 INT DEFAULT NULL)
   RETURNS void AS
@@ -69,46 +77,112 @@ CREATE OR REPLACE FUNCTION get_infos(
   token UUID, OUT info1 INT, OUT info2 INT)
   RETURNS record AS
   'provsql','get_infos' LANGUAGE C;
+CREATE OR REPLACE FUNCTION set_extra(
+  token UUID, data TEXT)
+  RETURNS void AS
+  'provsql','set_extra' LANGUAGE C;
+CREATE OR REPLACE FUNCTION get_extra(
+  token UUID)
+  RETURNS TEXT AS
+  'provsql','get_extra' LANGUAGE C;
 CREATE OR REPLACE FUNCTION get_nb_gates() RETURNS BIGINT AS
   'provsql', 'get_nb_gates' LANGUAGE C;
 
-CREATE UNLOGGED TABLE provenance_circuit_extra(
-  gate UUID,
-  info1 INT,
-  info2 INT);
-
-CREATE UNLOGGED TABLE aggregation_circuit_extra(
-  gate UUID PRIMARY KEY,
-  aggfnoid INT,
-  aggtype INT,
-  val VARCHAR
-);
-
-CREATE UNLOGGED TABLE aggregation_values(
-  gate UUID PRIMARY KEY,
-  val VARCHAR
-);
+CREATE OR REPLACE FUNCTION add_gate_trigger()
+  RETURNS TRIGGER AS
+  'provsql','add_gate_trigger' LANGUAGE C;
 
-CREATE INDEX ON provenance_circuit_extra (gate);
+CREATE OR REPLACE FUNCTION create_add_gate_trigger(_tbl regclass)
+  RETURNS void AS
+$$
+BEGIN
+  -- Transition tables let all input gates of a statement be created in
+  -- one pass; they are only available from PostgreSQL 10
+  IF current_setting('server_version_num')::integer >= 100000 THEN
+    EXECUTE format('CREATE TRIGGER add_gate AFTER INSERT ON %I REFERENCING NEW TABLE AS new_table FOR EACH STATEMENT EXECUTE PROCEDURE provsql.add_gate_trigger()',_tbl);
+  ELSE
+    EXECUTE format('CREATE TRIGGER add_gate BEFORE INSERT ON %I FOR EACH ROW EXECUTE PROCEDURE provsql.add_gate_trigger()',_tbl);
+  END IF;
+END
+$$ LANGUAGE plpgsql;
 
-CREATE OR REPLACE FUNCTION add_gate_trigger()
+CREATE OR REPLACE FUNCTION set_prob_trigger()
   RETURNS TRIGGER AS
+  'provsql','set_prob_trigger' LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION create_set_prob_trigger(_tbl regclass, prob_column text)
+  RETURNS void AS
 $$
-DECLARE
-  attribute RECORD;
 BEGIN
-  PERFORM create_gate(NEW.provsql, 'input');
-  RETURN NEW;
+  -- Triggers fire in name order, so that the input gates created by
+  -- add_gate exist when their probabilities are set
+  IF current_setting('server_version_num')::integer >= 100000 THEN
+    EXECUTE format('CREATE TRIGGER set_prob_insert AFTER INSERT ON %I REFERENCING NEW TABLE AS new_table FOR EACH STATEMENT EXECUTE PROCEDURE provsql.set_prob_trigger(%L)',_tbl,prob_column);
+    -- Transition tables cannot be combined with a column list: the
+    -- rows whose probability column changed are found by the trigger
+    EXECUTE format('CREATE TRIGGER set_prob_update AFTER UPDATE ON %I REFERENCING OLD TABLE AS old_table NEW TABLE AS new_table FOR EACH STATEMENT EXECUTE PROCEDURE provsql.set_prob_trigger(%L)',_tbl,prob_column);
+  ELSE
+    EXECUTE format('CREATE TRIGGER set_prob_insert AFTER INSERT ON %I FOR EACH ROW EXECUTE PROCEDURE provsql.set_prob_trigger(%L)',_tbl,prob_column);
+    -- Only updates of the probability column are of interest
+    EXECUTE format('CREATE TRIGGER set_prob_update AFTER UPDATE OF %I ON %I FOR EACH ROW WHEN (OLD.%I IS DISTINCT FROM NEW.%I) EXECUTE PROCEDURE provsql.set_prob_trigger(%L)',prob_column,_tbl,prob_column,prob_column,prob_column);
+  END IF;
 END
-$$ LANGUAGE plpgsql SET search_path=provsql,pg_temp SECURITY DEFINER;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION load_prob_column(_tbl regclass, prob_column text)
+  RETURNS void AS
+  'provsql','load_prob_column' LANGUAGE C;
 
-CREATE OR REPLACE FUNCTION add_provenance(_tbl regclass)
+CREATE OR REPLACE FUNCTION bulk_input_tokens_start(_tbl regclass, nb_tuples bigint)
+  RETURNS void AS
+  'provsql','bulk_input_tokens_start' LANGUAGE C;
+CREATE OR REPLACE FUNCTION register_input_token(token UUID)
+  RETURNS UUID AS
+  'provsql','register_input_token' LANGUAGE C VOLATILE;
+CREATE OR REPLACE FUNCTION bulk_input_tokens_end(success boolean = true)
+  RETURNS void AS
+  'provsql','bulk_input_tokens_end' LANGUAGE C;
+
+CREATE OR REPLACE FUNCTION add_provenance_progress(
+  OUT pid integer,
+  OUT relid regclass,
+  OUT tuples_total bigint,
+  OUT tuples_done bigint)
+  RETURNS SETOF record AS
+  'provsql','add_provenance_progress' LANGUAGE C;
+
+CREATE OR REPLACE VIEW stat_progress_add_provenance AS
+  SELECT * FROM add_provenance_progress();
+
+CREATE OR REPLACE FUNCTION add_provenance(_tbl regclass, bulk boolean = false, prob_column text = NULL)
   RETURNS void AS
 $$
 BEGIN
-  EXECUTE format('ALTER TABLE %I ADD COLUMN provsql UUID UNIQUE DEFAULT public.uuid_generate_v4()', _tbl);
-  EXECUTE format('SELECT provsql.create_gate(provsql, ''input'') FROM %I', _tbl);
-  EXECUTE format('CREATE TRIGGER add_gate BEFORE INSERT ON %I FOR EACH ROW EXECUTE PROCEDURE provsql.add_gate_trigger()',_tbl);
+  IF bulk THEN
+    -- Tokens are generated, registered as input gates, and indexed
+    -- during the single rewrite of the table caused by the volatile
+    -- default
+    PERFORM provsql.bulk_input_tokens_start(_tbl,
+      (SELECT GREATEST(reltuples,0)::bigint FROM pg_class WHERE oid=_tbl));
+    BEGIN
+      EXECUTE format('ALTER TABLE %I ADD COLUMN provsql UUID UNIQUE DEFAULT provsql.register_input_token(public.uuid_generate_v4())', _tbl);
+      EXECUTE format('ALTER TABLE %I ALTER COLUMN provsql SET DEFAULT public.uuid_generate_v4()', _tbl);
+    EXCEPTION WHEN OTHERS THEN
+      PERFORM provsql.bulk_input_tokens_end(false);
+      RAISE;
+    END;
+    PERFORM provsql.bulk_input_tokens_end();
+  ELSE
+    EXECUTE format('ALTER TABLE %I ADD COLUMN provsql UUID UNIQUE DEFAULT public.uuid_generate_v4()', _tbl);
+    EXECUTE format('SELECT provsql.create_gate(provsql, ''input'') FROM %I', _tbl);
+  END IF;
+  PERFORM provsql.create_add_gate_trigger(_tbl);
+  IF prob_column IS NOT NULL THEN
+    -- Probabilities of all input gates are read in a single scan, and
+    -- later kept in sync with the column
+    PERFORM provsql.load_prob_column(_tbl, prob_column);
+    PERFORM provsql.create_set_prob_trigger(_tbl, prob_column);
+  END IF;
 END
 $$ LANGUAGE plpgsql SECURITY DEFINER;
 
@@ -122,56 +196,25 @@ BEGIN
     EXECUTE format('DROP TRIGGER add_gate on %I', _tbl);
   EXCEPTION WHEN undefined_object THEN
   END;
+  -- Only tables with a probability column have these triggers; the
+  -- notices for missing ones are silenced by the SET clause below
+  EXECUTE format('DROP TRIGGER IF EXISTS set_prob_insert on %I', _tbl);
+  EXECUTE format('DROP TRIGGER IF EXISTS set_prob_update on %I', _tbl);
 END
-$$ LANGUAGE plpgsql;
+$$ LANGUAGE plpgsql SET client_min_messages = warning;
+
+CREATE OR REPLACE FUNCTION repair_key_gates(_tbl regclass, key_att text)
+  RETURNS void AS
+  'provsql','repair_key_gates' LANGUAGE C;
 
 CREATE OR REPLACE FUNCTION repair_key(_tbl regclass, key_att text)
   RETURNS void AS
 $$
-DECLARE
-  key RECORD;
-  key_token uuid;
-  token uuid;
-  record RECORD;
-  nb_rows INTEGER;
-  ind INTEGER;
-  select_key_att TEXT;
-  where_condition TEXT;
 BEGIN
-  IF key_att = '' THEN
-    key_att := '()';
-    select_key_att := '1';
-  ELSE
-    select_key_att := key_att;
-  END IF;
-
   EXECUTE format('ALTER TABLE %I ADD COLUMN provsql_temp UUID UNIQUE DEFAULT public.uuid_generate_v4()', _tbl);
-
-  FOR key IN
-    EXECUTE format('SELECT %s AS key FROM %I GROUP BY %s', select_key_att, _tbl, key_att)
-  LOOP
-    IF key_att = '()' THEN
-      where_condition := '';
-    ELSE
-      where_condition := format('WHERE %s = %L', key_att, key.key);
-    END IF;
-
-    EXECUTE format('SELECT COUNT(*) FROM %I %s', _tbl, where_condition) INTO nb_rows;
-
-    key_token := public.uuid_generate_v4();
-    ind := 1;
-    FOR record IN
-      EXECUTE format('SELECT provsql_temp FROM %I %s', _tbl, where_condition)
-    LOOP
-      token:=record.provsql_temp;
-      PERFORM provsql.create_gate(token, 'mulinput', ARRAY[key_token]);
-      PERFORM provsql.set_prob(token, 1./nb_rows);
-      PERFORM provsql.set_infos(token, ind);
-      ind := ind + 1;
-    END LOOP;
-  END LOOP;
+  PERFORM provsql.repair_key_gates(_tbl, key_att);
   EXECUTE format('ALTER TABLE %I RENAME COLUMN provsql_temp TO provsql', _tbl);
-  EXECUTE format('CREATE TRIGGER add_gate BEFORE INSERT ON %I FOR EACH ROW EXECUTE PROCEDURE provsql.add_gate_trigger()',_tbl);
+  PERFORM provsql.create_add_gate_trigger(_tbl);
 END
 $$ LANGUAGE plpgsql;
 
@@ -259,20 +302,11 @@ CREATE OR REPLACE FUNCTION provenance_project(token UUID, VARIADIC positions int
 $$
 DECLARE
   project_token uuid;
-  rec record;
 BEGIN
   project_token:=uuid_generate_v5(uuid_ns_provsql(),concat(token,positions));
 
-  LOCK TABLE provenance_circuit_extra;
-  SELECT 1 FROM provenance_circuit_extra WHERE gate = project_token INTO rec;
-  IF rec IS NULL THEN
-    PERFORM create_gate(project_token, 'project', ARRAY[token::uuid]);
-    INSERT INTO provenance_circuit_extra
-      SELECT gate, case when info=0 then null else info end, idx
-      FROM (
-              SELECT project_token gate, info, idx FROM unnest(positions) WITH ORDINALITY AS a(info, idx)
-            ) t;
-  END IF;
+  PERFORM create_gate(project_token, 'project', ARRAY[token::uuid]);
+  PERFORM set_extra(project_token, positions::text);
 
   RETURN project_token;
 END
@@ -283,17 +317,12 @@ CREATE OR REPLACE FUNCTION provenance_eq(token UUID, pos1 int, pos2 int)
 $$
 DECLARE
   eq_token uuid;
-  rec record;
 BEGIN
   eq_token:=uuid_generate_v5(uuid_ns_provsql(),concat(token,pos1,pos2));
 
-  LOCK TABLE provenance_circuit_extra;
-  SELECT 1 FROM provenance_circuit_extra WHERE gate = eq_token INTO rec;
-  IF rec IS NULL THEN
-    PERFORM create_gate(eq_token, 'eq', ARRAY[token::uuid]);
-    PERFORM set_infos(eq_token, pos1, pos2);
-    INSERT INTO provenance_circuit_extra VALUES(eq_token, pos1, pos2);
-  END IF;
+  PERFORM create_gate(eq_token, 'eq', ARRAY[token::uuid]);
+  PERFORM set_infos(eq_token, pos1, pos2);
+
   RETURN eq_token;
 END
 $$ LANGUAGE plpgsql SET search_path=provsql,pg_temp,public SECURITY DEFINER;
@@ -324,114 +353,15 @@ BEGIN
 END
 $$ LANGUAGE plpgsql STRICT SET search_path=provsql,pg_temp,public SECURITY DEFINER;
 
-CREATE OR REPLACE FUNCTION provenance_evaluate(
-  token UUID,
-  token2value regclass,
-  element_one anyelement,
-  value_type regtype,
-  plus_function regproc,
-  times_function regproc,
-  monus_function regproc,
-  delta_function regproc)
-  RETURNS anyelement AS
-$$
-DECLARE
-  gate_type provenance_gate;
-  result ALIAS FOR $0;
-BEGIN
-  SELECT get_gate_type(token) INTO gate_type;
-
-  IF gate_type IS NULL THEN
-    RETURN NULL;
-  ELSIF gate_type='input' THEN
-    EXECUTE format('SELECT * FROM %I WHERE provenance=%L',token2value,token) INTO result;
-    IF result IS NULL THEN
-      result:=element_one;
-    END IF;
-  ELSIF gate_type='mulinput' THEN
-    SELECT concat('{',(get_children(token))[1]::text,'=',(get_infos(token)).info1,'}') INTO result;
-  ELSIF gate_type='plus' THEN
-    EXECUTE format('SELECT %I(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L,%L)) FROM unnest(get_children(%L)) AS t',
-      plus_function,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,delta_function,token)
-    INTO result;
-  ELSIF gate_type='times' THEN
-    EXECUTE format('SELECT %I(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L,%L)) FROM unnest(get_children(%L)) AS t',
-      times_function,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,delta_function,token)
-    INTO result;
-  ELSIF gate_type='monus' THEN
-    IF monus_function IS NULL THEN
-      RAISE EXCEPTION USING MESSAGE='Provenance with negation evaluated over a semiring without monus function';
-    ELSE
-      EXECUTE format('SELECT %I(a[1],a[2]) FROM (SELECT array_agg(provsql.provenance_evaluate(t,%L,%L::%s,%L,%L,%L,%L,%L)) AS a FROM unnest(get_children(%L)) AS t) tmp',
-        monus_function,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,delta_function,token)
-      INTO result;
-    END IF;
-  ELSIF gate_type='eq' THEN
-    EXECUTE format('SELECT provsql.provenance_evaluate((get_children(%L))[1],%L,%L::%s,%L,%L,%L,%L,%L)',
-      token,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,delta_function)
-    INTO result;
-  ELSIF gate_type='delta' THEN
-    IF delta_function IS NULL THEN
-      RAISE EXCEPTION USING MESSAGE='Provenance with aggregation evaluated over a semiring without delta function';
-    ELSE
-      EXECUTE format('SELECT %I(a) FROM (SELECT provsql.provenance_evaluate((get_children(%L))[1],%L,%L::%s,%L,%L,%L,%L,%L) AS a) tmp',
-        delta_function,token,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,delta_function)
-      INTO result;
-    END IF;
-  ELSIF gate_type='zero' THEN
-    EXECUTE format('SELECT %I(a) FROM (SELECT %L::%I AS a WHERE FALSE) temp',plus_function,element_one,value_type) INTO result;
-  ELSIF gate_type='one' THEN
-    EXECUTE format('SELECT %L::%I',element_one,value_type) INTO result;
-  ELSIF gate_type='project' THEN
-    EXECUTE format('SELECT provsql.provenance_evaluate((get_children(%L))[1],%L,%L::%s,%L,%L,%L,%L,%L)',
-      token,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,delta_function)
-    INTO result;
-  ELSE
-    RAISE EXCEPTION USING MESSAGE='Unknown gate type';
-  END IF;
-  RETURN result;
-END
-$$ LANGUAGE plpgsql;
-
-CREATE OR REPLACE FUNCTION aggregation_evaluate(
-  token UUID,
-  token2value regclass,
-  agg_function_final regproc,
-  agg_function regproc,
-  semimod_function regproc,
-  element_one anyelement,
-  value_type regtype,
-  plus_function regproc,
-  times_function regproc,
-  monus_function regproc,
-  delta_function regproc)
-  RETURNS anyelement AS
+CREATE OR REPLACE FUNCTION get_gate_infos(token UUID, gate_type provenance_gate)
+  RETURNS INTEGER[] AS
 $$
-DECLARE
-  gt provenance_gate;
-  result ALIAS FOR $0;
-BEGIN
-  SELECT get_gate_type(token) INTO gt;
-
-  IF gt IS NULL THEN
-    RETURN NULL;
-  ELSIF gt='agg' THEN
-    EXECUTE format('SELECT %I(%I(provsql.aggregation_evaluate(t,%L,%L,%L,%L,%L::%s,%L,%L,%L,%L,%L)),pp.proname::varchar) FROM
-                    unnest(get_children(%L)) AS t, provsql.aggregation_circuit_extra ace, pg_proc pp
-                    WHERE ace.gate=%L AND pp.oid=ace.aggfnoid
-                    GROUP BY pp.proname',
-      agg_function_final, agg_function,token2value,agg_function_final,agg_function,semimod_function,element_one,value_type,value_type,plus_function,times_function,
-      monus_function,delta_function,token,token)
-    INTO result;
-  ELSE
-    -- gt='semimod'
-    EXECUTE format('SELECT %I(val,provsql.provenance_evaluate((get_children(%L))[1],%L,%L::%s,%L,%L,%L,%L,%L)) FROM provsql.aggregation_values av WHERE gate=(get_children(%L))[2]',
-      semimod_function,token,token2value,element_one,value_type,value_type,plus_function,times_function,monus_function,delta_function,token)
-    INTO result;
-  END IF;
-  RETURN result;
-END
-$$ LANGUAGE plpgsql;
+  SELECT CASE gate_type
+    -- Project gates without extra information have an empty extra
+    WHEN 'project' THEN NULLIF(provsql.get_extra(token),'')::INTEGER[]
+    WHEN 'eq' THEN ARRAY[(provsql.get_infos(token)).info1, (provsql.get_infos(token)).info2]
+  END
+$$ LANGUAGE SQL STABLE;
 
 CREATE TYPE gate_with_desc AS (f UUID, t UUID, gate_type provenance_gate, desc_str CHARACTER VARYING, infos INTEGER[]);
 
@@ -445,17 +375,14 @@ BEGIN
       SELECT $1,t,provsql.get_gate_type($1) FROM unnest(provsql.get_children($1)) AS t
         UNION ALL
       SELECT p1.t,u,provsql.get_gate_type(p1.t) FROM transitive_closure p1, unnest(provsql.get_children(p1.t)) AS u)
-    SELECT t1.*, infos FROM (
+    SELECT t1.*, provsql.get_gate_infos(t1.f, t1.gate_type) FROM (
       SELECT f::uuid,t::uuid,gate_type,NULL FROM transitive_closure
         UNION ALL
       SELECT p2.provenance::uuid as f, NULL::uuid, ''input'', CAST (p2.value AS varchar) FROM transitive_closure p1 JOIN ' || token2desc || ' AS p2
         ON p2.provenance=t
         UNION ALL
       SELECT provenance::uuid as f, NULL::uuid, ''input'', CAST (value AS varchar) FROM ' || token2desc || ' WHERE provenance=$1
-    ) t1
-    LEFT OUTER JOIN (
-      SELECT gate, ARRAY_AGG(ARRAY[info1,info2]) infos FROM provsql.provenance_circuit_extra GROUP BY gate
-    ) t2 on t1.f=t2.gate'
+    ) t1'
   USING token LOOP;
   RETURN;
 END
@@ -497,15 +424,13 @@ $$
       SELECT $1,t,id,provsql.get_gate_type($1) FROM unnest(provsql.get_children($1)) WITH ORDINALITY AS a(t,id)
         UNION ALL
       SELECT p1.t,u,id,provsql.get_gate_type(p1.t) FROM transitive_closure p1, unnest(provsql.get_children(p1.t)) WITH ORDINALITY AS a(u, id)
-    ) SELECT t1.f, t1.t, t1.gate_type, table_name, nb_columns, infos, row_number() over() FROM (
+    ) SELECT t1.f, t1.t, t1.gate_type, table_name, nb_columns, provsql.get_gate_infos(t1.f, t1.gate_type), row_number() over() FROM (
       SELECT f, t::uuid, idx, gate_type, NULL AS table_name, NULL AS nb_columns FROM transitive_closure
       UNION ALL
         SELECT DISTINCT t, NULL::uuid, NULL::int, 'input'::provenance_gate, (id).table_name, (id).nb_columns FROM transitive_closure JOIN (SELECT t AS prov, provsql.identify_token(t) as id FROM transitive_closure WHERE t NOT IN (SELECT f FROM transitive_closure)) temp ON t=prov
       UNION ALL
         SELECT DISTINCT $1, NULL::uuid, NULL::int, 'input'::provenance_gate, (id).table_name, (id).nb_columns FROM (SELECT provsql.identify_token($1) AS id WHERE $1 NOT IN (SELECT f FROM transitive_closure)) temp
-      ) t1 LEFT OUTER JOIN (
-      SELECT gate, ARRAY_AGG(ARRAY[info1,info2]) infos FROM provenance_circuit_extra GROUP BY gate
-    ) t2 ON t1.f=t2.gate ORDER BY f,idx
+      ) t1 ORDER BY f,idx
 $$
 LANGUAGE sql;
 
@@ -556,14 +481,11 @@ BEGIN
     agg_tok := uuid_generate_v5(
       uuid_ns_provsql(),
       concat('agg',array_to_string(tokens, ',')));
-    LOCK TABLE aggregation_circuit_extra;
     PERFORM create_gate(agg_tok, 'agg', array_agg(t))
       FROM unnest(tokens) AS t
       WHERE t != gate_zero();
-    BEGIN
-      INSERT INTO aggregation_circuit_extra VALUES(agg_tok, aggfnoid, aggtype, agg_val);
-    EXCEPTION WHEN unique_violation THEN
-    END;
+    PERFORM set_infos(agg_tok, aggfnoid, aggtype);
+    PERFORM set_extra(agg_tok, agg_val);
   END IF;
 
   RETURN '( '||agg_tok||' , '||agg_val||' )';
@@ -577,19 +499,20 @@ DECLARE
   semimod_token uuid;
   value_token uuid;
 BEGIN
-  LOCK TABLE aggregation_values;
-
-  SELECT uuid_generate_v5(uuid_ns_provsql(),concat('value',CAST(val AS VARCHAR)))
-    INTO value_token;
+  -- The NULL value has its own value gate, distinct from that of the
+  -- empty string
+  IF val IS NULL THEN
+    SELECT uuid_generate_v5(uuid_ns_provsql(),'null') INTO value_token;
+  ELSE
+    SELECT uuid_generate_v5(uuid_ns_provsql(),concat('value',CAST(val AS VARCHAR)))
+      INTO value_token;
+  END IF;
   SELECT uuid_generate_v5(uuid_ns_provsql(),concat('semimod',value_token,token))
     INTO semimod_token;
 
-  --create value gates
+  --create value gates; the extra information of NULL values is NULL
   PERFORM create_gate(value_token,'value');
-  BEGIN
-    INSERT INTO aggregation_values VALUES(value_token,CAST(val AS VARCHAR));
-  EXCEPTION WHEN unique_violation THEN
-  END;
+  PERFORM set_extra(value_token,CAST(val AS VARCHAR));
 
   --create semimod gate
   PERFORM create_gate(semimod_token,'semimod',ARRAY[token::uuid,value_token]);
@@ -598,6 +521,32 @@ BEGIN
 END
 $$ LANGUAGE plpgsql SET search_path=provsql,pg_temp,public SECURITY DEFINER;
 
+CREATE OR REPLACE FUNCTION provenance_cmp(token UUID, op text, val anyelement)
+  RETURNS UUID AS
+$$
+DECLARE
+  cmp_token uuid;
+  value_token uuid;
+BEGIN
+  IF op NOT IN ('<', '<=', '=', '<>', '>=', '>') THEN
+    RAISE EXCEPTION USING MESSAGE='Unknown comparison operator ' || op;
+  END IF;
+
+  SELECT uuid_generate_v5(uuid_ns_provsql(),concat('value',CAST(val AS VARCHAR)))
+    INTO value_token;
+  SELECT uuid_generate_v5(uuid_ns_provsql(),concat('cmp',token,op,value_token))
+    INTO cmp_token;
+
+  PERFORM create_gate(value_token,'value');
+  PERFORM set_extra(value_token,CAST(val AS VARCHAR));
+
+  PERFORM create_gate(cmp_token,'cmp',ARRAY[token,value_token]);
+  PERFORM set_extra(cmp_token,op);
+
+  RETURN cmp_token;
+END
+$$ LANGUAGE plpgsql STRICT SET search_path=provsql,pg_temp,public SECURITY DEFINER;
+
 CREATE OR REPLACE FUNCTION provenance_evaluate(
   token UUID,
   token2value regclass,
@@ -609,6 +558,13 @@ CREATE OR REPLACE FUNCTION provenance_evaluate(
   RETURNS anyelement AS
   'provsql','provenance_evaluate' LANGUAGE C STABLE;
 
+CREATE OR REPLACE FUNCTION provenance_evaluate_builtin(
+  token UUID,
+  semiring text,
+  token2value regclass = NULL)
+  RETURNS text AS
+  'provsql','provenance_evaluate_builtin' LANGUAGE C STABLE;
+
 CREATE OR REPLACE FUNCTION aggregation_evaluate(
   token UUID,
   token2value regclass,
@@ -626,10 +582,63 @@ CREATE OR REPLACE FUNCTION aggregation_evaluate(
 CREATE OR REPLACE FUNCTION probability_evaluate(
   token UUID,
   method text = NULL,
-  arguments text = NULL)
+  arguments text = NULL,
+  scenario text = NULL)
   RETURNS DOUBLE PRECISION AS
   'provsql','probability_evaluate' LANGUAGE C STABLE;
 
+CREATE OR REPLACE FUNCTION probability_evaluate(
+  token UUID,
+  evidence UUID[],
+  negative_evidence UUID[] = NULL,
+  method text = NULL,
+  arguments text = NULL,
+  scenario text = NULL)
+  RETURNS DOUBLE PRECISION AS
+  'provsql','probability_evaluate_evidence' LANGUAGE C STABLE;
+
+CREATE OR REPLACE FUNCTION probability_gradient(
+  IN token UUID,
+  IN method text = NULL,
+  IN arguments text = NULL,
+  OUT variable UUID,
+  OUT gradient DOUBLE PRECISION)
+  RETURNS SETOF record AS
+  'provsql','probability_gradient'
+  LANGUAGE C STABLE;
+
+CREATE OR REPLACE FUNCTION probability_evaluate_scenarios(
+  IN token UUID,
+  IN scenarios regclass,
+  IN method text = NULL,
+  IN arguments text = NULL,
+  OUT scenario text,
+  OUT probability DOUBLE PRECISION)
+  RETURNS SETOF record AS
+  'provsql','probability_evaluate_scenarios'
+  LANGUAGE C STABLE;
+
+CREATE OR REPLACE FUNCTION load_scenarios(scenarios regclass)
+  RETURNS void AS
+$$
+BEGIN
+  -- One call to set_scenario_probs, and thus one acquisition of the
+  -- lock on the in-memory circuit, per scenario
+  EXECUTE format('SELECT provsql.set_scenario_probs(scenario::text, array_agg(provenance), array_agg(probability::double precision)) FROM %s GROUP BY scenario', scenarios);
+END
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION expected_value(token UUID)
+  RETURNS DOUBLE PRECISION AS
+  'provsql','expected_value' LANGUAGE C STABLE;
+
+CREATE OR REPLACE FUNCTION count_distribution(
+  IN token UUID,
+  OUT count BIGINT,
+  OUT probability DOUBLE PRECISION)
+  RETURNS SETOF record AS
+  'provsql','count_distribution' LANGUAGE C STABLE;
+
 CREATE OR REPLACE FUNCTION shapley(
   token UUID,
   variable UUID,
@@ -669,6 +678,36 @@ CREATE OR REPLACE FUNCTION banzhaf_all_vars(
   $$ SELECT * FROM provsql.shapley_all_vars(token, method, arguments, 't') $$
   LANGUAGE SQL;
 
+CREATE OR REPLACE FUNCTION most_probable_explanation(
+  IN token UUID,
+  IN method text = NULL,
+  IN arguments text = NULL,
+  OUT inputs UUID[],
+  OUT probability DOUBLE PRECISION)
+  RETURNS record AS
+  'provsql','most_probable_explanation' LANGUAGE C STABLE;
+
+CREATE OR REPLACE FUNCTION top_k_explanations(
+  IN token UUID,
+  IN k integer,
+  IN method text = NULL,
+  IN arguments text = NULL,
+  OUT inputs UUID[],
+  OUT probability DOUBLE PRECISION)
+  RETURNS SETOF record AS
+  'provsql','top_k_explanations'
+  LANGUAGE C STABLE;
+
+CREATE OR REPLACE FUNCTION sample_worlds(
+  token UUID,
+  n integer,
+  seed bigint = NULL,
+  method text = NULL,
+  arguments text = NULL)
+  RETURNS SETOF UUID[] AS
+  'provsql','sample_worlds'
+  LANGUAGE C VOLATILE;
+
 CREATE OR REPLACE FUNCTION view_circuit(
   token UUID,
   token2desc regclass,
@@ -694,6 +733,5 @@ SELECT create_gate(gate_zero(), 'zero');
 SELECT create_gate(gate_one(), 'one');
 
 GRANT USAGE ON SCHEMA provsql TO PUBLIC;
-GRANT SELECT ON provenance_circuit_extra TO PUBLIC;
 
 SET search_path TO public;
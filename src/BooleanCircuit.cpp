@@ -1,4 +1,5 @@
 #include "BooleanCircuit.h"
+#include <algorithm>
 #include <type_traits>
 
 extern "C" {
@@ -695,6 +696,12 @@ unsigned BooleanCircuit::getInfo(gate_t g) const
     return it->second;
 }
 
+std::string BooleanCircuit::freshGateName() const
+{
+  // Not a valid UUID, and distinct from the names of all other gates
+  return "#" + std::to_string(getNbGates());
+}
+
 void BooleanCircuit::rewriteMultivaluedGatesRec(
   const std::vector<gate_t> &muls,
   const std::vector<double> &cumulated_probs,
@@ -708,10 +715,12 @@ void BooleanCircuit::rewriteMultivaluedGatesRec(
   }
 
   unsigned mid = (start+end)/2;
+  // Probability of the alternatives start..mid among start..end
+  double total = cumulated_probs[end+1] - cumulated_probs[start];
   auto g = setGate(
+    freshGateName(),
     BooleanGate::IN,
-    (cumulated_probs[mid+1] - cumulated_probs[start]) /
-    (cumulated_probs[end] - cumulated_probs[start]));
+    total > 0. ? (cumulated_probs[mid+1] - cumulated_probs[start]) / total : 0.);
   auto not_g = setGate(BooleanGate::NOT);
   getWires(not_g).push_back(g);
 
@@ -742,25 +751,189 @@ void BooleanCircuit::rewriteMultivaluedGates()
   for(const auto &[var, muls]: var2mulinput)
   {
     const unsigned n = muls.size();
-    std::vector<double> cumulated_probs(n);
+    // cumulated_probs[i] is the total probability of the first i
+    // alternatives
+    std::vector<double> cumulated_probs(n+1);
     double cumulated_prob=0.;
 
     for(unsigned i=0; i<n; ++i) {
       cumulated_prob += getProb(muls[i]);
-      cumulated_probs[i] = cumulated_prob;
+      cumulated_probs[i+1] = cumulated_prob;
       gates[static_cast<std::underlying_type<gate_t>::type>(muls[i])] = BooleanGate::AND;
       getWires(muls[i]).clear();
     }
 
     std::vector<gate_t> prefix;
     prefix.reserve(static_cast<unsigned>(log(n)/log(2)+2));
-    if(!almost_equals(cumulated_probs[n-1],1.)) {
-      prefix.push_back(setGate(BooleanGate::IN, cumulated_probs[n-1]));
+    if(!almost_equals(cumulated_probs[n],1.)) {
+      prefix.push_back(setGate(freshGateName(), BooleanGate::IN, cumulated_probs[n]));
     }
     rewriteMultivaluedGatesRec(muls, cumulated_probs, 0, n-1, prefix);
   }
 }
 
+std::pair<gate_t, gate_t> BooleanCircuit::exclusiveGates(
+  const std::vector<gate_t> &ins,
+  unsigned start,
+  unsigned end)
+{
+  if(start==end) {
+    auto not_g = setGate(BooleanGate::NOT);
+    getWires(not_g).push_back(ins[start]);
+    return {not_g, ins[start]};
+  }
+
+  unsigned mid = (start+end)/2;
+  auto [none_left, one_left] = exclusiveGates(ins, start, mid);
+  auto [none_right, one_right] = exclusiveGates(ins, mid+1, end);
+
+  auto none = setGate(BooleanGate::AND);
+  getWires(none) = {none_left, none_right};
+  auto left = setGate(BooleanGate::AND);
+  getWires(left) = {one_left, none_right};
+  auto right = setGate(BooleanGate::AND);
+  getWires(right) = {none_left, one_right};
+  auto one = setGate(BooleanGate::OR);
+  getWires(one) = {left, right};
+
+  return {none, one};
+}
+
+gate_t BooleanCircuit::rewriteMultivaluedGatesExclusive(gate_t g, double &factor)
+{
+  std::map<gate_t,std::vector<gate_t> > var2mulinput;
+  for(auto mul: mulinputs) {
+    var2mulinput[*getWires(mul).begin()].push_back(mul);
+  }
+  mulinputs.clear();
+
+  auto root = setGate(freshGateName(), BooleanGate::AND);
+  getWires(root).push_back(g);
+  factor = 1.;
+
+  for(const auto &[var, muls]: var2mulinput)
+  {
+    double total=0.;
+    for(auto mul: muls)
+      total += getProb(mul);
+    const bool complete = almost_equals(total, 1.) || total > 1.;
+
+    // Alternatives whose odds are proportional to their probabilities,
+    // and to that of no alternative being chosen when the key is not
+    // complete
+    const double c = complete ? 1. : 1.-total;
+    for(auto mul: muls) {
+      double p = getProb(mul);
+      gates[static_cast<std::underlying_type<gate_t>::type>(mul)] = BooleanGate::IN;
+      getWires(mul).clear();
+      inputs.insert(mul);
+      setProb(mul, p/(p+c));
+      factor *= c/(p+c);
+    }
+    factor /= c;
+
+    auto [none, one] = exclusiveGates(muls, 0, muls.size()-1);
+    if(complete)
+      getWires(root).push_back(one);
+    else {
+      auto at_most_one = setGate(BooleanGate::OR);
+      getWires(at_most_one) = {none, one};
+      getWires(root).push_back(at_most_one);
+    }
+  }
+
+  return root;
+}
+
+std::map<long long, gate_t> BooleanCircuit::addSumGates(
+  const std::vector<gate_t> &terms,
+  const std::vector<long long> &values,
+  long long bound)
+{
+  const bool saturate = bound < std::numeric_limits<long long>::max() &&
+                        std::all_of(values.begin(), values.end(),
+                                    [](long long v) {
+    return v >= 0;
+  });
+  std::map<long long, gate_t> sums{{0, setGate(BooleanGate::AND)}};
+
+  // Dynamic programming over the terms: the sum of the first i terms
+  // is s if either term i is false and the sum of the first i-1 terms
+  // is s, or term i is true and the sum of the first i-1 terms is s
+  // minus its value; disjunctions are therefore deterministic
+  for(size_t i=0; i<terms.size(); ++i) {
+    gate_t not_term = setGate(BooleanGate::NOT);
+    addWire(not_term, terms[i]);
+
+    std::map<long long, std::vector<gate_t> > next;
+    for(const auto &[s, g]: sums) {
+      gate_t without = setGate(BooleanGate::AND);
+      addWire(without, not_term);
+      addWire(without, g);
+      next[s].push_back(without);
+
+      long long t;
+      if(__builtin_add_overflow(s, values[i], &t))
+        throw CircuitException("Overflow in sum of values");
+      if(saturate && t > bound)
+        t = bound+1;
+      gate_t with = setGate(BooleanGate::AND);
+      addWire(with, terms[i]);
+      addWire(with, g);
+      next[t].push_back(with);
+    }
+
+    if(next.size() > MAX_SUMS)
+      throw CircuitException("Too many possible values of sum (more than " + std::to_string(MAX_SUMS) + ")");
+
+    sums.clear();
+    for(const auto &[s, v]: next) {
+      if(v.size() == 1)
+        sums[s] = v[0];
+      else {
+        gate_t g = setGate(BooleanGate::OR);
+        for(auto c: v)
+          addWire(g, c);
+        sums[s] = g;
+      }
+    }
+  }
+
+  return sums;
+}
+
+gate_t BooleanCircuit::addIndicatorGates(
+  const std::vector<gate_t> &gs,
+  std::vector<gate_t> &indicators)
+{
+  auto root = setGate(freshGateName(), BooleanGate::AND);
+
+  for(auto g: gs) {
+    auto y = setGate(freshGateName(), BooleanGate::IN);
+    indicators.push_back(y);
+
+    auto not_y = setGate(BooleanGate::NOT);
+    addWire(not_y, y);
+    auto not_g = setGate(BooleanGate::NOT);
+    addWire(not_g, g);
+
+    // Deterministic disjunction of y∧g and ¬y∧¬g
+    auto both = setGate(BooleanGate::AND);
+    addWire(both, y);
+    addWire(both, g);
+    auto neither = setGate(BooleanGate::AND);
+    addWire(neither, not_y);
+    addWire(neither, not_g);
+    auto equivalent = setGate(BooleanGate::OR);
+    addWire(equivalent, both);
+    addWire(equivalent, neither);
+
+    addWire(root, equivalent);
+  }
+
+  return root;
+}
+
 gate_t BooleanCircuit::interpretAsDDInternal(gate_t g, std::set<gate_t> &seen, dDNNF &dd) const {
   gate_t dg{0};
 
@@ -823,7 +996,7 @@ dDNNF BooleanCircuit::interpretAsDD(gate_t g) const
   return dd;
 }
 
-dDNNF BooleanCircuit::makeDD(gate_t g, const std::string &method, const std::string &args) const
+dDNNF BooleanCircuit::makeDD(gate_t g, const std::string &method, const std::string &args, bool deterministic) const
 {
   if(method=="compilation") {
     return compilation(g, args);
@@ -837,11 +1010,18 @@ dDNNF BooleanCircuit::makeDD(gate_t g, const std::string &method, const std::str
     }
   } else {
     dDNNF dd;
-    try {
-      dd = interpretAsDD(g);
-      if(provsql_verbose>=20)
-        elog(NOTICE, "Circuit interpreted as dD, %ld gates", dd.getNbGates());
-    } catch(CircuitException &) {
+    bool interpreted = false;
+
+    if(!deterministic) {
+      try {
+        dd = interpretAsDD(g);
+        interpreted = true;
+        if(provsql_verbose>=20)
+          elog(NOTICE, "Circuit interpreted as dD, %ld gates", dd.getNbGates());
+      } catch(CircuitException &) {}
+    }
+
+    if(!interpreted) {
       try {
         TreeDecomposition td(*this);
         dd = dDNNFTreeDecompositionBuilder{
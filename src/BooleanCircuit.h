@@ -4,6 +4,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <set>
+#include <limits>
 #include <map>
 #include <vector>
 
@@ -18,12 +19,21 @@ bool evaluate(gate_t g, const std::unordered_set<gate_t> &sampled) const;
 std::string Tseytin(gate_t g, bool display_prob) const;
 gate_t interpretAsDDInternal(gate_t g, std::set<gate_t> &seen, dDNNF &dd) const;
 double independentEvaluationInternal(gate_t g, std::set<gate_t> &seen) const;
+// Name of a gate introduced when rewriting multivalued gates; d-DNNFs
+// built from the circuit identify its input gates, and their root, by
+// their names
+std::string freshGateName() const;
 void rewriteMultivaluedGatesRec(
   const std::vector<gate_t> &muls,
   const std::vector<double> &cumulated_probs,
   unsigned start,
   unsigned end,
   std::vector<gate_t> &prefix);
+// Gates true when none, and when exactly one, of ins[start..end] is true
+std::pair<gate_t, gate_t> exclusiveGates(
+  const std::vector<gate_t> &ins,
+  unsigned start,
+  unsigned end);
 
 protected:
 std::set<gate_t> inputs;
@@ -63,8 +73,37 @@ double monteCarlo(gate_t g, unsigned samples) const;
 double WeightMC(gate_t g, std::string opt) const;
 double independentEvaluation(gate_t g) const;
 void rewriteMultivaluedGates();
+// Alternative rewriting of multivalued gates, which become input gates,
+// conjoined with g in the returned gate along with the constraint that
+// at most one alternative per key is true. Every world of the original
+// circuit corresponds to a single world of the rewritten one, whose
+// probability is that of the original world times factor; unlike
+// rewriteMultivaluedGates, this preserves most probable worlds.
+gate_t rewriteMultivaluedGatesExclusive(gate_t g, double &factor);
+// Maximal number of distinct sums in addSumGates
+static constexpr size_t MAX_SUMS = 10000;
+// Adds, for every possible value s of the sum of the values of the
+// true terms, a gate true exactly when that sum is s. Values are
+// integers, so that sums are exact. When all values are nonnegative,
+// all sums greater than bound are represented by a single gate, for the
+// key bound+1. Throws a CircuitException if a sum overflows, or if
+// there are more than MAX_SUMS distinct sums.
+std::map<long long, gate_t> addSumGates(
+  const std::vector<gate_t> &terms,
+  const std::vector<long long> &values,
+  long long bound = std::numeric_limits<long long>::max());
+// Adds, for every gate of gs, a fresh input gate, appended to
+// indicators, and returns a gate true exactly when each of these input
+// gates has the same value as the corresponding gate of gs
+gate_t addIndicatorGates(const std::vector<gate_t> &gs, std::vector<gate_t> &indicators);
 dDNNF interpretAsDD(gate_t g) const;
-dDNNF makeDD(gate_t g, const std::string &method, const std::string &args) const;
+// d-DNNF for g, through the given method; by default, independent
+// circuits are interpreted as they are, independent OR gates being
+// encoded through NOT and AND gates. When deterministic is true, the
+// result is obtained by tree decomposition or, failing that, knowledge
+// compilation, so that its OR gates are deterministic and its NOT gates
+// all over input gates.
+dDNNF makeDD(gate_t g, const std::string &method, const std::string &args, bool deterministic = false) const;
 
 virtual std::string toString(gate_t g) const override;
 std::string exportCircuit(gate_t g) const;
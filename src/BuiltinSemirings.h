@@ -0,0 +1,376 @@
+#ifndef BUILTIN_SEMIRINGS_H
+#define BUILTIN_SEMIRINGS_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Circuit.h"
+
+// Semirings natively implemented, to be used with
+// GenericCircuit::evaluate. Input gates (and mulinput gates) are
+// mapped to the textual representation of their value, as found in a
+// provenance mapping; unmapped inputs evaluate to the neutral element
+// of times, as for provenance_evaluate.
+//
+// Unlike provenance_evaluate, which maps a mulinput gate to the text
+// {key=index} converted to the semiring type, mulinput gates are here
+// evaluated as plain inputs: such a text is not a valid value of most
+// of these semirings, and the value of the alternative in the mapping
+// is what the formula and why semirings are expected to show.
+template<class Derived, typename T>
+class MappedSemiring {
+protected:
+const std::unordered_map<gate_t, std::string> &mapping;
+
+Derived &self() {
+  return static_cast<Derived &>(*this);
+}
+
+public:
+typedef T value_type;
+
+explicit MappedSemiring(const std::unordered_map<gate_t, std::string> &m) : mapping(m) {
+}
+
+T input(gate_t g) {
+  auto it = mapping.find(g);
+  if(it == mapping.end())
+    return self().one();
+  else
+    return self().parse(it->second);
+}
+T mulinput(gate_t g) {
+  return input(g);
+}
+// Tokens that are not gates are only found as keys of mulinput
+// gates, and their value is never used
+T missing() {
+  return self().one();
+}
+};
+
+class CountingSemiring : public MappedSemiring<CountingSemiring, long long> {
+public:
+using MappedSemiring::MappedSemiring;
+
+long long zero() {
+  return 0;
+}
+long long one() {
+  return 1;
+}
+long long plus(const std::vector<long long> &v) {
+  long long r = 0;
+  for(auto x: v)
+    r += x;
+  return r;
+}
+long long times(const std::vector<long long> &v) {
+  long long r = 1;
+  for(auto x: v)
+    r *= x;
+  return r;
+}
+long long monus(long long x, long long y) {
+  return x < y ? 0 : x - y;
+}
+long long delta(long long x) {
+  return x > 0 ? 1 : 0;
+}
+long long parse(const std::string &s) {
+  return std::stoll(s);
+}
+std::string toString(long long x) {
+  return std::to_string(x);
+}
+};
+
+class BooleanSemiring : public MappedSemiring<BooleanSemiring, bool> {
+public:
+using MappedSemiring::MappedSemiring;
+
+bool zero() {
+  return false;
+}
+bool one() {
+  return true;
+}
+bool plus(const std::vector<bool> &v) {
+  return std::find(v.begin(), v.end(), true) != v.end();
+}
+bool times(const std::vector<bool> &v) {
+  return std::find(v.begin(), v.end(), false) == v.end();
+}
+bool monus(bool x, bool y) {
+  return x && !y;
+}
+bool delta(bool x) {
+  return x;
+}
+bool parse(const std::string &s) {
+  return s == "t" || s == "true" || s == "1" || s == "yes" || s == "on";
+}
+std::string toString(bool x) {
+  return x ? "true" : "false";
+}
+};
+
+// Why-provenance: sets of witnesses, each witness being a set of
+// input values
+typedef std::set<std::set<std::string> > why_t;
+
+class WhySemiring : public MappedSemiring<WhySemiring, why_t> {
+public:
+using MappedSemiring::MappedSemiring;
+
+why_t zero() {
+  return why_t();
+}
+why_t one() {
+  return why_t{{}};
+}
+why_t plus(const std::vector<why_t> &v) {
+  why_t r;
+  for(const auto &x: v)
+    r.insert(x.begin(), x.end());
+  return r;
+}
+why_t times(const std::vector<why_t> &v) {
+  why_t r = one();
+  for(const auto &x: v) {
+    why_t product;
+    for(const auto &w1: r)
+      for(const auto &w2: x) {
+        auto w = w1;
+        w.insert(w2.begin(), w2.end());
+        product.insert(std::move(w));
+      }
+    r = std::move(product);
+  }
+  return r;
+}
+why_t monus(const why_t &x, const why_t &y) {
+  why_t r;
+  std::set_difference(x.begin(), x.end(), y.begin(), y.end(), std::inserter(r, r.begin()));
+  return r;
+}
+why_t delta(const why_t &x) {
+  return x.empty() ? zero() : one();
+}
+why_t parse(const std::string &s) {
+  return why_t{{s}};
+}
+std::string toString(const why_t &x) {
+  std::string r = "{";
+  bool first_witness = true;
+  for(const auto &w: x) {
+    if(!first_witness)
+      r += ",";
+    first_witness = false;
+    r += "{";
+    bool first = true;
+    for(const auto &s: w) {
+      if(!first)
+        r += ",";
+      first = false;
+      r += s;
+    }
+    r += "}";
+  }
+  return r + "}";
+}
+};
+
+// Symbolic formula, in the same format as the formula semiring of the
+// regression tests
+class FormulaSemiring : public MappedSemiring<FormulaSemiring, std::string> {
+private:
+static std::string join(const std::vector<std::string> &v, const std::string &sep) {
+  if(v.size() == 1)
+    return v[0];
+
+  std::string r = "(";
+  for(unsigned i=0; i<v.size(); ++i) {
+    if(i>0)
+      r += sep;
+    r += v[i];
+  }
+  return r + ")";
+}
+
+public:
+using MappedSemiring::MappedSemiring;
+
+std::string zero() {
+  return "𝟘";
+}
+std::string one() {
+  return "𝟙";
+}
+std::string plus(const std::vector<std::string> &v) {
+  if(v.empty())
+    return zero();
+  std::vector<std::string> sorted(v);
+  std::sort(sorted.begin(), sorted.end());
+  return join(sorted, " ⊕ ");
+}
+std::string times(const std::vector<std::string> &v) {
+  if(v.empty())
+    return one();
+  return join(v, " ⊗ ");
+}
+std::string monus(const std::string &x, const std::string &y) {
+  return "(" + x + " ⊖ " + y + ")";
+}
+std::string delta(const std::string &x) {
+  return "δ(" + x + ")";
+}
+std::string parse(const std::string &s) {
+  return s;
+}
+std::string toString(const std::string &x) {
+  return x;
+}
+};
+
+// Common textual representation of floating-point values
+inline std::string double2string(double x)
+{
+  if(std::isinf(x))
+    return x > 0 ? "Infinity" : "-Infinity";
+
+  std::ostringstream oss;
+  oss.precision(15);
+  oss << x;
+  return oss.str();
+}
+
+// Min-plus semiring over the reals extended with +∞
+class TropicalSemiring : public MappedSemiring<TropicalSemiring, double> {
+public:
+using MappedSemiring::MappedSemiring;
+
+double zero() {
+  return std::numeric_limits<double>::infinity();
+}
+double one() {
+  return 0.;
+}
+double plus(const std::vector<double> &v) {
+  double r = zero();
+  for(auto x: v)
+    r = std::min(r, x);
+  return r;
+}
+double times(const std::vector<double> &v) {
+  double r = one();
+  for(auto x: v)
+    r += x;
+  return r;
+}
+double monus(double x, double y) {
+  return y <= x ? zero() : x;
+}
+double delta(double x) {
+  return std::isinf(x) ? zero() : one();
+}
+double parse(const std::string &s) {
+  return std::stod(s);
+}
+std::string toString(double x) {
+  return double2string(x);
+}
+};
+
+// Max-times semiring over [0,1]
+class ViterbiSemiring : public MappedSemiring<ViterbiSemiring, double> {
+public:
+using MappedSemiring::MappedSemiring;
+
+double zero() {
+  return 0.;
+}
+double one() {
+  return 1.;
+}
+double plus(const std::vector<double> &v) {
+  double r = zero();
+  for(auto x: v)
+    r = std::max(r, x);
+  return r;
+}
+double times(const std::vector<double> &v) {
+  double r = one();
+  for(auto x: v)
+    r *= x;
+  return r;
+}
+double monus(double x, double y) {
+  return y >= x ? zero() : x;
+}
+double delta(double x) {
+  return x > 0. ? one() : zero();
+}
+double parse(const std::string &s) {
+  return std::stod(s);
+}
+std::string toString(double x) {
+  return double2string(x);
+}
+};
+
+// Security semiring: (min, max) over a totally ordered set of
+// clearance levels, given from the lowest to the highest
+class SecuritySemiring : public MappedSemiring<SecuritySemiring, unsigned> {
+private:
+std::vector<std::string> levels;
+
+public:
+SecuritySemiring(const std::unordered_map<gate_t, std::string> &m, const std::vector<std::string> &l) :
+  MappedSemiring(m), levels(l) {
+  if(levels.empty())
+    throw CircuitException("No security levels for the security semiring");
+}
+
+unsigned zero() {
+  return levels.size()-1;
+}
+unsigned one() {
+  return 0;
+}
+unsigned plus(const std::vector<unsigned> &v) {
+  unsigned r = zero();
+  for(auto x: v)
+    r = std::min(r, x);
+  return r;
+}
+unsigned times(const std::vector<unsigned> &v) {
+  unsigned r = one();
+  for(auto x: v)
+    r = std::max(r, x);
+  return r;
+}
+unsigned monus(unsigned x, unsigned y) {
+  return y <= x ? zero() : x;
+}
+unsigned delta(unsigned x) {
+  return x == zero() ? zero() : one();
+}
+unsigned parse(const std::string &s) {
+  auto it = std::find(levels.begin(), levels.end(), s);
+  if(it == levels.end())
+    throw CircuitException("Unknown security level: " + s);
+  return it - levels.begin();
+}
+std::string toString(unsigned x) {
+  return levels[x];
+}
+};
+
+#endif /* BUILTIN_SEMIRINGS_H */
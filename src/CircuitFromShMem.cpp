@@ -1,9 +1,23 @@
+#include <algorithm>
+#include <cctype>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
-#include "BooleanCircuit.h"
+#include "CircuitFromShMem.h"
 #include "provsql_utils_cpp.h"
 
 extern "C" {
+#include "catalog/pg_namespace.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#if PG_VERSION_NUM >= 110000
+#include "utils/regproc.h"
+#endif
 #include "provsql_shmem.h"
 }
 
@@ -12,14 +26,229 @@ bool operator<(const pg_uuid_t a, const pg_uuid_t b)
   return memcmp(&a, &b, sizeof(pg_uuid_t))<0;
 }
 
-BooleanCircuit createBooleanCircuit(pg_uuid_t token)
+// Comparison between the result of an aggregate (as the sum of the
+// values of the terms that are true) and a constant, read from a cmp
+// gate
+struct Comparison {
+  gate_t gate;
+  Oid aggfnoid;
+  std::string op;
+  std::string bound;
+  std::vector<gate_t> terms;
+  std::vector<std::string> values;
+};
+
+static std::string get_extra(const provsqlHashEntry *entry)
 {
-  std::set<pg_uuid_t> to_process, processed;
-  to_process.insert(token);
+  if(entry->extra_len == PROVSQL_EXTRA_NULL)
+    return "";
+  return std::string(provsql_extra()+entry->extra_idx, entry->extra_len);
+}
+
+static void comparison_error(const char *message)
+{
+  LWLockRelease(provsql_shared_state->lock);
+  elog(ERROR, "%s", message);
+}
+
+// Reads the agg and value gates below a cmp gate; must be called with
+// the lock held
+static Comparison read_comparison(
+  gate_t id,
+  const provsqlHashEntry *entry,
+  BooleanCircuit &result,
+  std::set<pg_uuid_t> &to_process,
+  const std::set<pg_uuid_t> &processed)
+{
+  Comparison cmp{id, InvalidOid, get_extra(entry), "", {}, {}};
+  bool found;
+
+  if(entry->nb_children != 2)
+    comparison_error("Incorrect number of children for cmp gate");
+
+  pg_uuid_t agg_token = provsql_shared_state->wires[entry->children_idx];
+  pg_uuid_t value_token = provsql_shared_state->wires[entry->children_idx+1];
+
+  auto value = reinterpret_cast<provsqlHashEntry *>(hash_search(provsql_hash, &value_token, HASH_FIND, &found));
+  if(!found || value->type != gate_value)
+    comparison_error("Missing value gate for cmp gate");
+  cmp.bound = get_extra(value);
+
+  auto agg = reinterpret_cast<provsqlHashEntry *>(hash_search(provsql_hash, &agg_token, HASH_FIND, &found));
+  if(found && agg->type == gate_zero)
+    // Aggregate over no tuple
+    return cmp;
+  if(!found || agg->type != gate_agg)
+    comparison_error("Missing agg gate for cmp gate");
+  cmp.aggfnoid = agg->info1;
+
+  for(unsigned i=0; i<agg->nb_children; ++i) {
+    pg_uuid_t semimod_token = provsql_shared_state->wires[agg->children_idx+i];
+    auto semimod = reinterpret_cast<provsqlHashEntry *>(hash_search(provsql_hash, &semimod_token, HASH_FIND, &found));
+    if(!found || semimod->type != gate_semimod || semimod->nb_children != 2)
+      comparison_error("Incorrect child of agg gate");
+
+    pg_uuid_t provenance = provsql_shared_state->wires[semimod->children_idx];
+    pg_uuid_t term_value_token = provsql_shared_state->wires[semimod->children_idx+1];
+    auto term_value = reinterpret_cast<provsqlHashEntry *>(hash_search(provsql_hash, &term_value_token, HASH_FIND, &found));
+
+    cmp.terms.push_back(result.getGate(uuid2string(provenance)));
+    // NULL values do not contribute to the aggregate
+    cmp.values.push_back(found ? get_extra(term_value) : "");
+    if(processed.find(provenance)==processed.end())
+      to_process.insert(provenance);
+  }
+
+  return cmp;
+}
+
+static bool compare(long long x, const std::string &op, long long y)
+{
+  if(op == "<")
+    return x < y;
+  else if(op == "<=")
+    return x <= y;
+  else if(op == "=")
+    return x == y;
+  else if(op == "<>")
+    return x != y;
+  else if(op == ">=")
+    return x >= y;
+  else if(op == ">")
+    return x > y;
+  else
+    elog(ERROR, "Unknown comparison operator in cmp gate: %s", op.c_str());
+
+  return false; // unreachable
+}
+
+// Number written in decimal notation (as output for integer, numeric
+// and floating-point types), as mantissa*10^exponent; returns false if
+// it is not of this form or has too many significant digits
+static bool parse_decimal(const std::string &s, long long &mantissa, int &exponent)
+{
+  size_t i = 0;
+  bool negative = false, digits = false;
+  // Zeros read since the last nonzero digit, only added to the mantissa
+  // if followed by another nonzero digit
+  int zeros = 0;
+
+  mantissa = 0;
+  exponent = 0;
+
+  if(i < s.size() && (s[i] == '-' || s[i] == '+'))
+    negative = s[i++] == '-';
+
+  for(bool fraction = false; i < s.size(); ++i) {
+    if(s[i] == '.' && !fraction)
+      fraction = true;
+    else if(isdigit(static_cast<unsigned char>(s[i]))) {
+      digits = true;
+      if(fraction)
+        --exponent;
+      if(s[i] == '0') {
+        ++zeros;
+        continue;
+      }
+      for(; zeros >= 0; --zeros)
+        if(__builtin_mul_overflow(mantissa, 10LL, &mantissa))
+          return false;
+      zeros = 0;
+      if(__builtin_add_overflow(mantissa, static_cast<long long>(s[i] - '0'), &mantissa))
+        return false;
+    } else
+      break;
+  }
+  exponent += zeros;
+
+  if(!digits)
+    return false;
+
+  if(i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+    try {
+      size_t end;
+      exponent += std::stoi(s.substr(i+1), &end);
+      i += 1 + end;
+    } catch(std::logic_error &) {
+      return false;
+    }
+  }
+
+  if(i != s.size())
+    return false;
+
+  if(negative)
+    mantissa = -mantissa;
+
+  return true;
+}
+
+// Comparison gates are rewritten, once the whole circuit is loaded, as
+// the disjunction of the sum gates (see BooleanCircuit::addSumGates)
+// whose sum satisfies the comparison. Values and bound are scaled by
+// a common power of ten to integers, so that sums are exact.
+static void add_comparison(BooleanCircuit &c, const Comparison &cmp)
+{
+  if(OidIsValid(cmp.aggfnoid)) {
+    // Only the built-in count and sum, not user aggregates of the same
+    // name in another schema
+    const char *name = get_func_name(cmp.aggfnoid);
+    if(!name || get_func_namespace(cmp.aggfnoid) != PG_CATALOG_NAMESPACE ||
+       (strcmp(name, "count") && strcmp(name, "sum")))
+      elog(ERROR, "Comparison on aggregate %s not supported, only the built-in count and sum are", format_procedure(cmp.aggfnoid));
+  }
+
+  std::vector<std::pair<long long, int> > decimals;
+  int scale = 0;
+
+  for(unsigned i=0; i<=cmp.values.size(); ++i) {
+    const std::string &v = i<cmp.values.size() ? cmp.values[i] : cmp.bound;
+    long long mantissa = 0;
+    int exponent = 0;
+
+    // NULL values do not contribute to the aggregate
+    if(!v.empty() && !parse_decimal(v, mantissa, exponent))
+      elog(ERROR, "Non-numerical or too precise value in comparison on aggregate: %s", v.c_str());
+
+    decimals.emplace_back(mantissa, exponent);
+    if(mantissa != 0)
+      scale = std::max(scale, -exponent);
+  }
+
+  std::vector<long long> values;
+  for(const auto &[mantissa, exponent]: decimals) {
+    long long v = mantissa;
+    for(int e = exponent + scale; e > 0 && v != 0; --e)
+      if(__builtin_mul_overflow(v, 10LL, &v))
+        elog(ERROR, "Values of comparison on aggregate cannot be represented exactly");
+    values.push_back(v);
+  }
+  long long bound = values.back();
+  values.pop_back();
+
+  try {
+    for(const auto &[s, g]: c.addSumGates(cmp.terms, values, bound))
+      if(compare(s, cmp.op, bound))
+        c.addWire(cmp.gate, g);
+  } catch(CircuitException &e) {
+    elog(ERROR, "Comparison on aggregate: %s", e.what());
+  }
+}
+
+BooleanCircuit createBooleanCircuit(pg_uuid_t token, const char *scenario_name)
+{
+  return createBooleanCircuit(std::vector<pg_uuid_t>{token}, scenario_name);
+}
+
+BooleanCircuit createBooleanCircuit(const std::vector<pg_uuid_t> &tokens, const char *scenario_name)
+{
+  std::set<pg_uuid_t> to_process(tokens.begin(), tokens.end()), processed;
 
   BooleanCircuit result;
+  std::vector<Comparison> comparisons;
 
   LWLockAcquire(provsql_shared_state->lock, LW_SHARED);
+  int scenario = provsql_find_scenario(scenario_name ? scenario_name : provsql_scenario);
   while(!to_process.empty()) {
     pg_uuid_t uuid = *to_process.begin();
     to_process.erase(to_process.begin());
@@ -31,6 +260,9 @@ BooleanCircuit createBooleanCircuit(pg_uuid_t token)
 
     if(!found)
       result.setGate(f, BooleanGate::MULVAR);
+    else if(entry->type == gate_cmp)
+      comparisons.push_back(read_comparison(
+                              result.setGate(f, BooleanGate::OR), entry, result, to_process, processed));
     else {
       gate_t id;
 
@@ -39,15 +271,15 @@ BooleanCircuit createBooleanCircuit(pg_uuid_t token)
         if(std::isnan(entry->prob)) {
           entry->prob=1.;
         }
-        id = result.setGate(f, BooleanGate::IN, entry->prob);
+        id = result.setGate(f, BooleanGate::IN, provsql_scenario_prob(entry, scenario));
         break;
 
       case gate_mulinput:
-        if(std::isnan(entry->prob)) {
+        if(std::isnan(provsql_scenario_prob(entry, scenario))) {
           LWLockRelease(provsql_shared_state->lock);
           elog(ERROR, "Missing probability for mulinput token");
         }
-        id = result.setGate(f, BooleanGate::MULIN, entry->prob);
+        id = result.setGate(f, BooleanGate::MULIN, provsql_scenario_prob(entry, scenario));
         result.addWire(
           id,
           result.getGate(uuid2string(provsql_shared_state->wires[entry->children_idx])));
@@ -103,5 +335,62 @@ BooleanCircuit createBooleanCircuit(pg_uuid_t token)
   }
   LWLockRelease(provsql_shared_state->lock);
 
+  for(const auto &cmp: comparisons)
+    add_comparison(result, cmp);
+
+  return result;
+}
+
+GenericCircuit createGenericCircuit(
+  pg_uuid_t token,
+  const std::function<bool(const std::string &)> &stop)
+{
+  std::set<pg_uuid_t> to_process, processed;
+  to_process.insert(token);
+
+  GenericCircuit result;
+
+  LWLockAcquire(provsql_shared_state->lock, LW_SHARED);
+  int scenario = provsql_find_scenario(provsql_scenario);
+  while(!to_process.empty()) {
+    pg_uuid_t uuid = *to_process.begin();
+    to_process.erase(to_process.begin());
+    processed.insert(uuid);
+    std::string f{uuid2string(uuid)};
+
+    if(stop && memcmp(&uuid, &token, sizeof(pg_uuid_t)) && stop(f)) {
+      result.getGate(f);
+      continue;
+    }
+
+    bool found;
+    provsqlHashEntry *entry = reinterpret_cast<provsqlHashEntry *>(hash_search(provsql_hash, &uuid, HASH_FIND, &found));
+
+    if(!found) {
+      result.getGate(f);
+      continue;
+    }
+
+    gate_t id = result.setGate(f, entry->type);
+    result.setProb(id, provsql_scenario_prob(entry, scenario));
+    result.setInfos(id, entry->info1, entry->info2);
+    if(entry->extra_len == PROVSQL_EXTRA_NULL)
+      result.setNullExtra(id);
+    else if(entry->extra_len > 0)
+      result.setExtra(id, std::string(provsql_extra()+entry->extra_idx, entry->extra_len));
+
+    for(unsigned i=0; i<entry->nb_children; ++i) {
+      auto child = provsql_shared_state->wires[entry->children_idx+i];
+
+      result.addWire(
+        id,
+        result.getGate(uuid2string(child)));
+      // Key tokens of mulinput gates are not gates themselves
+      if(entry->type != gate_mulinput && processed.find(child)==processed.end())
+        to_process.insert(child);
+    }
+  }
+  LWLockRelease(provsql_shared_state->lock);
+
   return result;
 }
@@ -5,8 +5,23 @@ extern "C" {
 #include <postgres.h>
 }
 
+#include <functional>
+#include <string>
+#include <vector>
+
 #include "BooleanCircuit.h"
+#include "GenericCircuit.h"
 
-BooleanCircuit createBooleanCircuit(pg_uuid_t token);
+// Probabilities of input gates are those of the named probability
+// scenario, or of the active one (provsql.scenario) if scenario is NULL
+BooleanCircuit createBooleanCircuit(pg_uuid_t token, const char *scenario = nullptr);
+// Circuit containing the gates reachable from any of the tokens, so
+// that common subcircuits are only loaded once
+BooleanCircuit createBooleanCircuit(const std::vector<pg_uuid_t> &tokens, const char *scenario = nullptr);
+// Gates for which stop returns true (other than the root) are not
+// loaded, and are left as unknown gates in the circuit
+GenericCircuit createGenericCircuit(
+  pg_uuid_t token,
+  const std::function<bool(const std::string &)> &stop = nullptr);
 
 #endif /* CIRCUIT_FROM_SH_MEM */
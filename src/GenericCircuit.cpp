@@ -0,0 +1,91 @@
+#include "GenericCircuit.h"
+
+#include <cmath>
+#include <stack>
+#include <utility>
+
+gate_t GenericCircuit::addGate()
+{
+  auto id=Circuit::addGate();
+  known.push_back(false);
+  prob.push_back(NAN);
+  info1.push_back(0);
+  info2.push_back(0);
+  extra.push_back("");
+  null_extra.push_back(false);
+  return id;
+}
+
+gate_t GenericCircuit::setGate(const uuid &u, gate_type t)
+{
+  auto id = Circuit::setGate(u, t);
+  known[static_cast<std::underlying_type<gate_t>::type>(id)]=true;
+  return id;
+}
+
+gate_t GenericCircuit::setGate(gate_type t)
+{
+  auto id = Circuit::setGate(t);
+  known[static_cast<std::underlying_type<gate_t>::type>(id)]=true;
+  return id;
+}
+
+std::vector<gate_t> GenericCircuit::topologicalOrder(gate_t g) const
+{
+  std::vector<gate_t> result;
+  std::vector<bool> visited(gates.size(), false);
+
+  // Iterative depth-first search, to avoid stack overflows on deep
+  // circuits; a gate is output once all its children have been
+  std::stack<std::pair<gate_t, bool> > to_visit;
+  to_visit.push(std::make_pair(g, false));
+
+  while(!to_visit.empty()) {
+    auto [h, children_done] = to_visit.top();
+    to_visit.pop();
+
+    if(children_done) {
+      result.push_back(h);
+      continue;
+    }
+
+    if(visited[static_cast<std::underlying_type<gate_t>::type>(h)])
+      continue;
+    visited[static_cast<std::underlying_type<gate_t>::type>(h)]=true;
+
+    to_visit.push(std::make_pair(h, true));
+    for(auto c: getWires(h))
+      if(!visited[static_cast<std::underlying_type<gate_t>::type>(c)])
+        to_visit.push(std::make_pair(c, false));
+  }
+
+  return result;
+}
+
+std::string GenericCircuit::toString(gate_t g) const
+{
+  static const char *names[] = {
+    "input", "plus", "times", "monus", "project", "zero", "one", "eq",
+    "agg", "semimod", "cmp", "delta", "value", "mulinput"
+  };
+
+  if(!isKnown(g))
+    return getUUID(g);
+
+  std::string result = names[getGateType(g)];
+
+  if(getWires(g).empty())
+    return result;
+
+  result += "(";
+  bool first=true;
+  for(auto c: getWires(g)) {
+    if(!first)
+      result += ",";
+    first=false;
+    result += toString(c);
+  }
+  result += ")";
+
+  return result;
+}
@@ -0,0 +1,83 @@
+#ifndef GENERIC_CIRCUIT_H
+#define GENERIC_CIRCUIT_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include "provsql_utils.h"
+}
+
+#include "Circuit.hpp"
+
+// Provenance circuit as stored in shared memory, with the same gate
+// types, used for semiring evaluation
+class GenericCircuit : public Circuit<gate_type> {
+private:
+std::vector<bool> known;
+std::vector<double> prob;
+std::vector<unsigned> info1, info2;
+std::vector<std::string> extra;
+std::vector<bool> null_extra;
+
+public:
+gate_t addGate() override;
+gate_t setGate(const uuid &u, gate_type t) override;
+gate_t setGate(gate_type t) override;
+
+// Gates whose token has been referenced as a wire but that do not
+// exist in the in-memory circuit (e.g., key tokens of mulinput gates)
+bool isKnown(gate_t g) const {
+  return known[static_cast<std::underlying_type<gate_t>::type>(g)];
+}
+void setProb(gate_t g, double p) {
+  prob[static_cast<std::underlying_type<gate_t>::type>(g)]=p;
+}
+double getProb(gate_t g) const {
+  return prob[static_cast<std::underlying_type<gate_t>::type>(g)];
+}
+void setInfos(gate_t g, unsigned i1, unsigned i2) {
+  info1[static_cast<std::underlying_type<gate_t>::type>(g)]=i1;
+  info2[static_cast<std::underlying_type<gate_t>::type>(g)]=i2;
+}
+std::pair<unsigned, unsigned> getInfos(gate_t g) const {
+  return std::make_pair(
+    info1[static_cast<std::underlying_type<gate_t>::type>(g)],
+    info2[static_cast<std::underlying_type<gate_t>::type>(g)]);
+}
+void setExtra(gate_t g, std::string &&s) {
+  extra[static_cast<std::underlying_type<gate_t>::type>(g)]=std::move(s);
+}
+const std::string &getExtra(gate_t g) const {
+  return extra[static_cast<std::underlying_type<gate_t>::type>(g)];
+}
+// Gates whose extra information is the NULL value, such as value
+// gates of NULL values; their extra is empty
+void setNullExtra(gate_t g) {
+  null_extra[static_cast<std::underlying_type<gate_t>::type>(g)]=true;
+}
+bool isNullExtra(gate_t g) const {
+  return null_extra[static_cast<std::underlying_type<gate_t>::type>(g)];
+}
+
+// Gates reachable from g, children always before their parents
+std::vector<gate_t> topologicalOrder(gate_t g) const;
+
+// Value of gate g over semiring S, each gate reachable from g being
+// evaluated exactly once, in topological order; see GenericCircuit.hpp
+template<typename S>
+typename S::value_type evaluate(gate_t g, S &semiring) const;
+// Same, where the values of the gates already in memo are reused
+// rather than computed, and those of all evaluated gates are added to
+// memo
+template<typename S>
+typename S::value_type evaluate(
+  gate_t g,
+  S &semiring,
+  std::unordered_map<gate_t, typename S::value_type> *memo) const;
+
+virtual std::string toString(gate_t g) const override;
+};
+
+#endif /* GENERIC_CIRCUIT_H */
@@ -0,0 +1,97 @@
+#ifndef GENERIC_CIRCUIT_HPP
+#define GENERIC_CIRCUIT_HPP
+
+#include "GenericCircuit.h"
+
+template<typename S>
+typename S::value_type GenericCircuit::evaluate(gate_t g, S &semiring) const
+{
+  return evaluate(g, semiring, nullptr);
+}
+
+template<typename S>
+typename S::value_type GenericCircuit::evaluate(
+  gate_t g,
+  S &semiring,
+  std::unordered_map<gate_t, typename S::value_type> *memo) const
+{
+  std::vector<typename S::value_type> values(gates.size());
+
+  for(auto h: topologicalOrder(g)) {
+    typename S::value_type result;
+
+    if(memo) {
+      auto it = memo->find(h);
+      if(it != memo->end()) {
+        values[static_cast<std::underlying_type<gate_t>::type>(h)] = it->second;
+        continue;
+      }
+    }
+
+    if(!isKnown(h)) {
+      values[static_cast<std::underlying_type<gate_t>::type>(h)] = semiring.missing();
+      continue;
+    }
+
+    std::vector<typename S::value_type> children;
+    if(getGateType(h) != gate_mulinput)
+      for(auto c: getWires(h))
+        children.push_back(values[static_cast<std::underlying_type<gate_t>::type>(c)]);
+
+    switch(getGateType(h)) {
+    case gate_input:
+      result = semiring.input(h);
+      break;
+
+    case gate_mulinput:
+      result = semiring.mulinput(h);
+      break;
+
+    case gate_zero:
+      result = semiring.zero();
+      break;
+
+    case gate_one:
+      result = semiring.one();
+      break;
+
+    case gate_plus:
+      result = semiring.plus(children);
+      break;
+
+    case gate_times:
+      result = semiring.times(children);
+      break;
+
+    case gate_monus:
+      if(children.size()!=2)
+        throw CircuitException("Incorrect number of children for monus gate");
+      result = semiring.monus(children[0], children[1]);
+      break;
+
+    case gate_delta:
+      if(children.size()!=1)
+        throw CircuitException("Incorrect number of children for delta gate");
+      result = semiring.delta(children[0]);
+      break;
+
+    case gate_project:
+    case gate_eq:
+      if(children.empty())
+        throw CircuitException("Missing child for project or eq gate");
+      result = children[0];
+      break;
+
+    default:
+      throw CircuitException("Unknown gate type");
+    }
+
+    if(memo)
+      (*memo)[h] = result;
+    values[static_cast<std::underlying_type<gate_t>::type>(h)] = std::move(result);
+  }
+
+  return values[static_cast<std::underlying_type<gate_t>::type>(g)];
+}
+
+#endif /* GENERIC_CIRCUIT_HPP */
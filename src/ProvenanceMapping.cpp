@@ -0,0 +1,137 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/uuid.h"
+
+#include "provsql_utils.h"
+}
+
+#include "ProvenanceMapping.h"
+
+// Mappings up to this size (in bytes) are read in full the first time
+// they are used
+#define PRELOAD_MAX_SIZE (64*1024*1024)
+
+ProvenanceMapping::ProvenanceMapping(Oid relid, MemoryContext context) :
+  relid(relid), context(context), complete(false), initialized(false), type(InvalidOid)
+{
+}
+
+void ProvenanceMapping::initialize()
+{
+  Datum arg = ObjectIdGetDatum(relid);
+  Oid argtype = OIDOID;
+  bool isnull;
+  bool small;
+  Oid output_function;
+  bool isvarlena;
+
+  if(SPI_execute_with_args(
+       "SELECT pg_relation_size($1) <= " CppAsString2(PRELOAD_MAX_SIZE) ", "
+       "(SELECT atttypid FROM pg_attribute WHERE attrelid=$1 AND attname='value' AND NOT attisdropped)",
+       1, &argtype, &arg, NULL, true, 1) != SPI_OK_SELECT || SPI_processed != 1)
+    elog(ERROR, "Cannot read provenance mapping");
+
+  small = DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
+  type = DatumGetObjectId(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 2, &isnull));
+  if(isnull)
+    elog(ERROR, "Provenance mapping %s has no value column", get_rel_name(relid));
+  SPI_freetuptable(SPI_tuptable);
+
+  get_typlenbyval(type, &typlen, &typbyval);
+  getTypeOutputInfo(type, &output_function, &isvarlena);
+  fmgr_info_cxt(output_function, &output, context);
+
+  initialized = true;
+
+  if(small) {
+    std::string query = std::string("SELECT provenance, value FROM ") +
+                        DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(relid)));
+    readRows(query.c_str(), 0, NULL, NULL);
+    complete = true;
+  }
+}
+
+void ProvenanceMapping::readRows(const char *query, int nargs, Oid *argtypes, Datum *args)
+{
+  if(SPI_execute_with_args(query, nargs, argtypes, args, NULL, true, 0) != SPI_OK_SELECT)
+    elog(ERROR, "Cannot read provenance mapping");
+
+  MemoryContext old_context = MemoryContextSwitchTo(context);
+
+  for(uint64 i = 0; i < SPI_processed; ++i) {
+    bool isnull;
+    Datum token = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull);
+
+    if(isnull)
+      continue;
+
+    DatumValue v;
+    v.value = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 2, &v.isnull);
+    if(!v.isnull)
+      v.value = datumCopy(v.value, typbyval, typlen);
+
+    // As with SELECT ... INTO, the first row for a token is the one used
+    values.emplace(*DatumGetUUIDP(token), v);
+  }
+
+  MemoryContextSwitchTo(old_context);
+
+  SPI_freetuptable(SPI_tuptable);
+}
+
+void ProvenanceMapping::load(const std::vector<pg_uuid_t> &tokens)
+{
+  if(!initialized)
+    initialize();
+
+  if(complete)
+    return;
+
+  std::vector<Datum> missing;
+  for(const auto &t: tokens) {
+    if(values.find(t) != values.end() || queried.find(t) != queried.end())
+      continue;
+    queried.insert(t);
+    missing.push_back(UUIDPGetDatum(&t));
+  }
+
+  if(missing.empty())
+    return;
+
+  const constants_t constants = initialize_constants(true);
+  Datum arg = PointerGetDatum(construct_array(missing.data(), missing.size(), constants.OID_TYPE_UUID, UUID_LEN, false, 'c'));
+  Oid argtype = constants.OID_TYPE_UUID_ARRAY;
+  std::string query = std::string("SELECT provenance, value FROM ") +
+                      DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(relid))) +
+                      " WHERE provenance = ANY($1)";
+
+  readRows(query.c_str(), 1, &argtype, &arg);
+}
+
+bool ProvenanceMapping::lookup(const pg_uuid_t &token, DatumValue &value) const
+{
+  auto it = values.find(token);
+  if(it == values.end())
+    return false;
+
+  value = it->second;
+  return true;
+}
+
+std::string ProvenanceMapping::toString(const DatumValue &value) const
+{
+  if(value.isnull)
+    return "";
+
+  char *s = OutputFunctionCall(const_cast<FmgrInfo *>(&output), value.value);
+  std::string result(s);
+  pfree(s);
+  return result;
+}
@@ -0,0 +1,54 @@
+#ifndef PROVENANCE_MAPPING_H
+#define PROVENANCE_MAPPING_H
+
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+}
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "provsql_utils_cpp.h"
+
+// Values associated to tokens by a provenance mapping, i.e., a table
+// with columns value and provenance, as created by
+// create_provenance_mapping. Small mappings are read entirely in a
+// single scan the first time they are needed; for larger ones, only the
+// rows of requested tokens are read, in a single query per call to
+// load(). Values are stored in the given memory context.
+class ProvenanceMapping {
+private:
+Oid relid;
+MemoryContext context;
+bool complete;
+bool initialized;
+Oid type;
+int16 typlen;
+bool typbyval;
+FmgrInfo output;
+std::unordered_map<pg_uuid_t, DatumValue, UUIDHash, UUIDEqual> values;
+std::unordered_set<pg_uuid_t, UUIDHash, UUIDEqual> queried;
+
+void initialize();
+void readRows(const char *query, int nargs, Oid *argtypes, Datum *args);
+
+public:
+ProvenanceMapping(Oid relid, MemoryContext context);
+
+// Make sure the values of all tokens are available; must be called
+// between SPI_connect() and SPI_finish()
+void load(const std::vector<pg_uuid_t> &tokens);
+
+// Value associated to token, false if there is none
+bool lookup(const pg_uuid_t &token, DatumValue &value) const;
+
+Oid getType() const {
+  return type;
+}
+std::string toString(const DatumValue &value) const;
+};
+
+#endif /* PROVENANCE_MAPPING_H */
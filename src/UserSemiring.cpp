@@ -0,0 +1,275 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/htup_details.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "nodes/makefuncs.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+#include "utils/uuid.h"
+}
+
+#include "UserSemiring.h"
+#include "provsql_utils_cpp.h"
+
+FmgrFunction::FmgrFunction(Oid fnoid, const std::vector<Oid> &argtypes, Oid rettype, Oid collation) : collation(collation)
+{
+  List *args = NIL;
+
+  fmgr_info(fnoid, &flinfo);
+
+  // Dummy call expression, so that polymorphic functions can use
+  // get_fn_expr_argtype() to find out the types of their arguments
+  for(auto t: argtypes)
+    args = lappend(args, makeNullConst(t, -1, InvalidOid));
+  fmgr_info_set_expr(reinterpret_cast<Node *>(
+                       makeFuncExpr(fnoid, rettype, args, InvalidOid, collation, COERCE_EXPLICIT_CALL)),
+                     &flinfo);
+}
+
+DatumValue FmgrFunction::operator()(const std::vector<DatumValue> &args)
+{
+  DatumValue result;
+
+  if(flinfo.fn_strict)
+    for(const auto &a: args)
+      if(a.isnull)
+        return {(Datum) 0, true};
+
+#if PG_VERSION_NUM >= 120000
+  FunctionCallInfo fcinfo = reinterpret_cast<FunctionCallInfo>(palloc0(SizeForFunctionCallInfo(args.size())));
+#else
+  FunctionCallInfoData fcinfo_data;
+  FunctionCallInfo fcinfo = &fcinfo_data;
+#endif
+
+  InitFunctionCallInfoData(*fcinfo, &flinfo, args.size(), collation, NULL, NULL);
+  for(unsigned i=0; i<args.size(); ++i) {
+#if PG_VERSION_NUM >= 120000
+    fcinfo->args[i].value = args[i].value;
+    fcinfo->args[i].isnull = args[i].isnull;
+#else
+    fcinfo->arg[i] = args[i].value;
+    fcinfo->argnull[i] = args[i].isnull;
+#endif
+  }
+
+  result.value = FunctionCallInvoke(fcinfo);
+  result.isnull = fcinfo->isnull;
+
+#if PG_VERSION_NUM >= 120000
+  pfree(fcinfo);
+#endif
+
+  return result;
+}
+
+PGAggregate::PGAggregate(Oid aggfnoid, Oid input_type, Oid collation) :
+  aggfnoid(aggfnoid), input_type(input_type), plan(NULL)
+{
+  HeapTuple tuple = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggfnoid));
+  Oid transfn_oid, finalfn_oid;
+  bool isnull;
+  Datum d;
+
+  if(!HeapTupleIsValid(tuple))
+    elog(ERROR, "Function %s is not an aggregate", get_func_name(aggfnoid));
+
+  Form_pg_aggregate agg = reinterpret_cast<Form_pg_aggregate>(GETSTRUCT(tuple));
+  transtype = agg->aggtranstype;
+  transfn_oid = agg->aggtransfn;
+  finalfn_oid = agg->aggfinalfn;
+  d = SysCacheGetAttr(AGGFNOID, tuple, Anum_pg_aggregate_agginitval, &isnull);
+  has_initval = !isnull;
+  if(has_initval)
+    initval = TextDatumGetCString(d);
+  ReleaseSysCache(tuple);
+
+  get_typlenbyvalalign(input_type, &input_len, &input_byval, &input_align);
+
+  if(transtype == INTERNALOID || IsPolymorphicType(transtype)) {
+    // The state cannot be manipulated outside of an aggregation node
+    Oid array_type = get_array_type(input_type);
+    std::string query = std::string("SELECT ") +
+                        quote_qualified_identifier(get_namespace_name(get_func_namespace(aggfnoid)),
+                                                   get_func_name(aggfnoid)) +
+                        "(x) FROM unnest($1) AS x";
+
+    if(!OidIsValid(array_type))
+      elog(ERROR, "No array type for the type of aggregate %s", get_func_name(aggfnoid));
+
+    plan = SPI_prepare(query.c_str(), 1, &array_type);
+    if(!plan)
+      elog(ERROR, "Cannot prepare evaluation of aggregate %s", get_func_name(aggfnoid));
+  } else {
+    getTypeInputInfo(transtype, &transtype_input, &transtype_ioparam);
+    get_typlenbyval(transtype, &transtype_len, &transtype_byval);
+    transfn = FmgrFunction(transfn_oid, {transtype, input_type}, transtype, collation);
+    if(OidIsValid(finalfn_oid))
+      finalfn = FmgrFunction(finalfn_oid, {transtype}, get_func_rettype(finalfn_oid), collation);
+  }
+}
+
+DatumValue PGAggregate::applyThroughSPI(const std::vector<DatumValue> &inputs)
+{
+  std::vector<Datum> values;
+  bool *nulls_array = reinterpret_cast<bool *>(palloc(sizeof(bool)*(inputs.size()+1)));
+  int dims[1] = {static_cast<int>(inputs.size())};
+  int lbs[1] = {1};
+  DatumValue result;
+
+  for(unsigned i=0; i<inputs.size(); ++i) {
+    values.push_back(inputs[i].value);
+    nulls_array[i] = inputs[i].isnull;
+  }
+
+  Datum array = PointerGetDatum(construct_md_array(
+                                  values.data(), nulls_array, 1, dims, lbs,
+                                  input_type, input_len, input_byval, input_align));
+
+  if(SPI_execute_plan(plan, &array, NULL, true, 1) != SPI_OK_SELECT || SPI_processed != 1)
+    elog(ERROR, "Cannot evaluate aggregate %s", get_func_name(aggfnoid));
+
+  result.value = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &result.isnull);
+  if(!result.isnull) {
+    int16 len;
+    bool byval;
+    get_typlenbyval(SPI_gettypeid(SPI_tuptable->tupdesc, 1), &len, &byval);
+    result.value = datumCopy(result.value, byval, len);
+  }
+  SPI_freetuptable(SPI_tuptable);
+
+  pfree(nulls_array);
+
+  return result;
+}
+
+DatumValue PGAggregate::operator()(const std::vector<DatumValue> &inputs)
+{
+  if(plan)
+    return applyThroughSPI(inputs);
+
+  DatumValue state;
+
+  if(has_initval) {
+    state.value = OidInputFunctionCall(transtype_input, const_cast<char *>(initval.c_str()), transtype_ioparam, -1);
+    state.isnull = false;
+  } else {
+    state.value = (Datum) 0;
+    state.isnull = true;
+  }
+
+  for(const auto &v: inputs) {
+    if(transfn.isStrict()) {
+      // Same convention as the executor: NULL inputs are skipped, and
+      // the first non-NULL input becomes the state if there is no
+      // initial value
+      if(v.isnull)
+        continue;
+      if(state.isnull) {
+        state.value = datumCopy(v.value, transtype_byval, transtype_len);
+        state.isnull = false;
+        continue;
+      }
+    }
+    state = transfn({state, v});
+  }
+
+  if(finalfn.isValid())
+    return finalfn({state});
+  else
+    return state;
+}
+
+UserSemiring::UserSemiring(const GenericCircuit &c, ProvenanceMapping &mapping, Oid type, DatumValue element_one,
+                           Oid plus_function, Oid times_function, Oid monus_function, Oid delta_function,
+                           Oid collation) :
+  c(c), type(type), element_one(element_one),
+  plus_function(plus_function, type, collation),
+  times_function(times_function, type, collation),
+  mapping(mapping)
+{
+  Oid typinput;
+  std::vector<pg_uuid_t> inputs;
+
+  if(OidIsValid(monus_function))
+    this->monus_function = FmgrFunction(monus_function, {type, type}, type, collation);
+  if(OidIsValid(delta_function))
+    this->delta_function = FmgrFunction(delta_function, {type}, type, collation);
+
+  getTypeInputInfo(type, &typinput, &type_ioparam);
+  fmgr_info(typinput, &type_input);
+
+  for(gate_t g{0}; g<c.getNbGates(); ++g)
+    if(c.isKnown(g) && c.getGateType(g) == gate_input)
+      inputs.push_back(string2uuid(c.getUUID(g)));
+  mapping.load(inputs);
+}
+
+DatumValue UserSemiring::zero()
+{
+  return plus_function({});
+}
+
+DatumValue UserSemiring::one()
+{
+  return element_one;
+}
+
+DatumValue UserSemiring::missing()
+{
+  return {(Datum) 0, true};
+}
+
+DatumValue UserSemiring::input(gate_t g)
+{
+  DatumValue result;
+
+  if(!mapping.lookup(string2uuid(c.getUUID(g)), result) || result.isnull)
+    return element_one;
+
+  if(mapping.getType() != type)
+    // Conversion through the textual representation, as PL/pgSQL
+    // would do
+    result.value = InputFunctionCall(&type_input, const_cast<char *>(mapping.toString(result).c_str()), type_ioparam, -1);
+
+  return result;
+}
+
+DatumValue UserSemiring::mulinput(gate_t g)
+{
+  std::string s = "{" + c.getUUID(c.getWires(g)[0]) + "=" + std::to_string(c.getInfos(g).first) + "}";
+
+  return {InputFunctionCall(&type_input, const_cast<char *>(s.c_str()), type_ioparam, -1), false};
+}
+
+DatumValue UserSemiring::plus(const std::vector<DatumValue> &v)
+{
+  return plus_function(v);
+}
+
+DatumValue UserSemiring::times(const std::vector<DatumValue> &v)
+{
+  return times_function(v);
+}
+
+DatumValue UserSemiring::monus(DatumValue x, DatumValue y)
+{
+  if(!monus_function.isValid())
+    elog(ERROR, "Provenance with negation evaluated over a semiring without monus function");
+
+  return monus_function({x, y});
+}
+
+DatumValue UserSemiring::delta(DatumValue x)
+{
+  if(!delta_function.isValid())
+    elog(ERROR, "Provenance with aggregation evaluated over a semiring without delta function");
+
+  return delta_function({x});
+}
@@ -0,0 +1,106 @@
+#ifndef USER_SEMIRING_H
+#define USER_SEMIRING_H
+
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "executor/spi.h"
+}
+
+#include <string>
+#include <vector>
+
+#include "GenericCircuit.h"
+#include "ProvenanceMapping.h"
+#include "provsql_utils_cpp.h"
+
+// A PostgreSQL function called through fmgr, with its FmgrInfo set up
+// once; argument types are recorded so that polymorphic functions can
+// resolve their actual types
+class FmgrFunction {
+private:
+FmgrInfo flinfo;
+Oid collation;
+
+public:
+FmgrFunction() : collation(InvalidOid) {
+  flinfo.fn_oid = InvalidOid;
+}
+FmgrFunction(Oid fnoid, const std::vector<Oid> &argtypes, Oid rettype, Oid collation);
+bool isValid() const {
+  return OidIsValid(flinfo.fn_oid);
+}
+bool isStrict() const {
+  return flinfo.fn_strict;
+}
+DatumValue operator()(const std::vector<DatumValue> &args);
+};
+
+// An aggregate function applied to a list of values of its input type.
+// The transition and final functions are directly called through fmgr;
+// aggregates with an internal or polymorphic transition type are
+// evaluated through SPI instead.
+class PGAggregate {
+private:
+Oid aggfnoid;
+Oid input_type;
+Oid transtype;
+bool has_initval;
+std::string initval;
+Oid transtype_input;
+Oid transtype_ioparam;
+int16 transtype_len;
+bool transtype_byval;
+FmgrFunction transfn;
+FmgrFunction finalfn;
+SPIPlanPtr plan;
+int16 input_len;
+bool input_byval;
+char input_align;
+
+DatumValue applyThroughSPI(const std::vector<DatumValue> &inputs);
+
+public:
+PGAggregate() : aggfnoid(InvalidOid), plan(NULL) {
+}
+PGAggregate(Oid aggfnoid, Oid input_type, Oid collation);
+DatumValue operator()(const std::vector<DatumValue> &inputs);
+};
+
+// Semiring whose elements are values of a PostgreSQL type, and whose
+// operations are user-provided PostgreSQL functions (aggregates for
+// plus and times); input gates are mapped to values through a
+// provenance mapping. Must be used between SPI_connect() and
+// SPI_finish().
+class UserSemiring {
+private:
+const GenericCircuit &c;
+Oid type;
+DatumValue element_one;
+PGAggregate plus_function;
+PGAggregate times_function;
+FmgrFunction monus_function;
+FmgrFunction delta_function;
+ProvenanceMapping &mapping;
+FmgrInfo type_input;
+Oid type_ioparam;
+
+public:
+typedef DatumValue value_type;
+
+UserSemiring(const GenericCircuit &c, ProvenanceMapping &mapping, Oid type, DatumValue element_one,
+             Oid plus_function, Oid times_function, Oid monus_function, Oid delta_function,
+             Oid collation);
+
+value_type zero();
+value_type one();
+value_type missing();
+value_type input(gate_t g);
+value_type mulinput(gate_t g);
+value_type plus(const std::vector<value_type> &v);
+value_type times(const std::vector<value_type> &v);
+value_type monus(value_type x, value_type y);
+value_type delta(value_type x);
+};
+
+#endif /* USER_SEMIRING_H */
@@ -0,0 +1,89 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/htup_details.h"
+#include "commands/trigger.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "utils/tuplestore.h"
+#include "utils/uuid.h"
+
+#include "provsql_shmem.h"
+
+/* Number of tokens registered in the in-memory circuit per lock
+ * acquisition when processing a transition table */
+#define ADD_GATE_BATCH_SIZE 1024
+
+PG_FUNCTION_INFO_V1(add_gate_trigger);
+
+/* Trigger creating an input gate for the provsql token of every new
+ * tuple. When used as an AFTER INSERT ... FOR EACH STATEMENT trigger with
+ * a transition table named in REFERENCING NEW TABLE (PostgreSQL >= 10),
+ * all tokens of the statement are registered in batches; otherwise, it
+ * is used as a BEFORE INSERT ... FOR EACH ROW trigger. */
+Datum add_gate_trigger(PG_FUNCTION_ARGS)
+{
+  TriggerData *trigdata = (TriggerData *) fcinfo->context;
+  TupleDesc tupdesc;
+  int attnum;
+
+  if(!CALLED_AS_TRIGGER(fcinfo))
+    elog(ERROR, "add_gate_trigger: not called by trigger manager");
+
+  tupdesc = trigdata->tg_relation->rd_att;
+  attnum = SPI_fnumber(tupdesc, "provsql");
+  if(attnum <= 0)
+    elog(ERROR, "add_gate_trigger: no provenance column in table %s",
+         RelationGetRelationName(trigdata->tg_relation));
+
+  if(TRIGGER_FIRED_FOR_ROW(trigdata->tg_event)) {
+    HeapTuple tuple = trigdata->tg_trigtuple;
+    bool isnull;
+    Datum token = heap_getattr(tuple, attnum, tupdesc, &isnull);
+
+    if(!isnull)
+      provsql_create_input_gates(DatumGetUUIDP(token), 1);
+
+    return PointerGetDatum(tuple);
+  } else {
+#if PG_VERSION_NUM >= 100000
+    Tuplestorestate *newtable = trigdata->tg_newtable;
+    TupleTableSlot *slot;
+    pg_uuid_t *tokens;
+    unsigned nb = 0;
+
+    if(newtable == NULL)
+      elog(ERROR, "add_gate_trigger: statement-level trigger requires a NEW TABLE transition relation");
+
+#if PG_VERSION_NUM >= 120000
+    slot = MakeSingleTupleTableSlot(tupdesc, &TTSOpsMinimalTuple);
+#else
+    slot = MakeSingleTupleTableSlot(tupdesc);
+#endif
+    tokens = palloc(sizeof(pg_uuid_t) * ADD_GATE_BATCH_SIZE);
+
+    tuplestore_rescan(newtable);
+    while(tuplestore_gettupleslot(newtable, true, false, slot)) {
+      bool isnull;
+      Datum token = slot_getattr(slot, attnum, &isnull);
+
+      if(isnull)
+        continue;
+
+      tokens[nb++] = *DatumGetUUIDP(token);
+      if(nb == ADD_GATE_BATCH_SIZE) {
+        provsql_create_input_gates(tokens, nb);
+        nb = 0;
+      }
+    }
+    if(nb > 0)
+      provsql_create_input_gates(tokens, nb);
+
+    pfree(tokens);
+    ExecDropSingleTupleTableSlot(slot);
+
+    return PointerGetDatum(NULL);
+#else
+    elog(ERROR, "add_gate_trigger: statement-level triggers require PostgreSQL 10 or later");
+#endif
+  }
+}
@@ -0,0 +1,189 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "storage/procarray.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+#include "utils/uuid.h"
+
+#include "provsql_shmem.h"
+
+/* Number of tokens buffered in the backend before being registered as
+ * input gates in the in-memory circuit, under a single lock acquisition */
+#define BULK_BATCH_SIZE 1024
+
+static pg_uuid_t bulk_tokens[BULK_BATCH_SIZE];
+static unsigned bulk_nb_tokens = 0;
+static int bulk_slot = -1;
+static bool bulk_active = false;
+
+static void bulk_flush(void)
+{
+  if(bulk_nb_tokens == 0)
+    return;
+
+  provsql_create_input_gates(bulk_tokens, bulk_nb_tokens);
+
+  if(bulk_slot >= 0) {
+    LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+    provsql_shared_state->progress[bulk_slot].tuples_done += bulk_nb_tokens;
+    LWLockRelease(provsql_shared_state->lock);
+  }
+
+  bulk_nb_tokens = 0;
+}
+
+/* Release the progress slot and close the bulk session */
+static void bulk_release(void)
+{
+  if(bulk_slot >= 0) {
+    LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+    provsql_shared_state->progress[bulk_slot].pid = 0;
+    LWLockRelease(provsql_shared_state->lock);
+    bulk_slot = -1;
+  }
+
+  bulk_active = false;
+}
+
+/* A bulk session does not outlive its transaction: buffered tokens are
+ * registered before commit, and discarded on abort */
+static void bulk_xact_callback(XactEvent event, void *arg)
+{
+  if(!bulk_active)
+    return;
+
+  switch(event) {
+  case XACT_EVENT_PRE_COMMIT:
+    bulk_flush();
+    bulk_release();
+    break;
+  case XACT_EVENT_ABORT:
+    bulk_nb_tokens = 0;
+    bulk_release();
+    break;
+  default:
+    break;
+  }
+}
+
+/* A slot is stale when the backend that claimed it no longer exists */
+static bool slot_in_use(const provsqlProgress *p)
+{
+  return p->pid != 0 && BackendPidGetProc(p->pid) != NULL;
+}
+
+PG_FUNCTION_INFO_V1(bulk_input_tokens_start);
+Datum bulk_input_tokens_start(PG_FUNCTION_ARGS)
+{
+  Oid relid = PG_GETARG_OID(0);
+  int64 total = PG_ARGISNULL(1)?0:PG_GETARG_INT64(1);
+  static bool callback_registered = false;
+
+  if(!callback_registered) {
+    RegisterXactCallback(bulk_xact_callback, NULL);
+    callback_registered = true;
+  }
+
+  if(bulk_active)
+    elog(ERROR, "A bulk registration of input tokens is already in progress");
+
+  bulk_nb_tokens = 0;
+  bulk_slot = -1;
+  bulk_active = true;
+
+  LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+
+  for(int i=0; i<PROVSQL_NB_PROGRESS_SLOTS; ++i) {
+    provsqlProgress *p = &provsql_shared_state->progress[i];
+    if(p->pid == MyProcPid || !slot_in_use(p)) {
+      p->pid = MyProcPid;
+      p->relid = relid;
+      p->tuples_total = total;
+      p->tuples_done = 0;
+      bulk_slot = i;
+      break;
+    }
+  }
+
+  LWLockRelease(provsql_shared_state->lock);
+
+  // No free slot: the operation proceeds without progress reporting
+  PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(register_input_token);
+Datum register_input_token(PG_FUNCTION_ARGS)
+{
+  pg_uuid_t *token;
+
+  if(PG_ARGISNULL(0))
+    elog(ERROR, "Invalid NULL value passed to register_input_token");
+
+  if(!bulk_active)
+    elog(ERROR, "register_input_token called outside of a bulk registration of input tokens");
+
+  token = DatumGetUUIDP(PG_GETARG_DATUM(0));
+
+  bulk_tokens[bulk_nb_tokens++] = *token;
+  if(bulk_nb_tokens == BULK_BATCH_SIZE)
+    bulk_flush();
+
+  PG_RETURN_UUID_P(token);
+}
+
+PG_FUNCTION_INFO_V1(bulk_input_tokens_end);
+Datum bulk_input_tokens_end(PG_FUNCTION_ARGS)
+{
+  bool success = PG_ARGISNULL(0) || PG_GETARG_BOOL(0);
+
+  if(success)
+    bulk_flush();
+  else
+    bulk_nb_tokens = 0;
+
+  bulk_release();
+
+  PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(add_provenance_progress);
+Datum add_provenance_progress(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+  MemoryContext per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+  MemoryContext oldcontext    = MemoryContextSwitchTo(per_query_ctx);
+
+  TupleDesc tupdesc = rsinfo->expectedDesc;
+  Tuplestorestate *tupstore     = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+  provsqlProgress progress[PROVSQL_NB_PROGRESS_SLOTS];
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+
+  LWLockAcquire(provsql_shared_state->lock, LW_SHARED);
+  memcpy(progress, provsql_shared_state->progress, sizeof(progress));
+  LWLockRelease(provsql_shared_state->lock);
+
+  for(int i=0; i<PROVSQL_NB_PROGRESS_SLOTS; ++i) {
+    if(slot_in_use(&progress[i])) {
+      Datum values[4] = {
+        Int32GetDatum(progress[i].pid),
+        ObjectIdGetDatum(progress[i].relid),
+        Int64GetDatum(progress[i].tuples_total),
+        Int64GetDatum(progress[i].tuples_done)
+      };
+      bool nulls[4] = {0, 0, 0, 0};
+
+      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+  }
+
+  tuplestore_donestoring(tupstore);
+  MemoryContextSwitchTo(oldcontext);
+
+  PG_RETURN_NULL();
+}
@@ -0,0 +1,158 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/uuid.h"
+#include "executor/spi.h"
+
+#include "provsql_shmem.h"
+#include "provsql_utils.h"
+
+PG_FUNCTION_INFO_V1(aggregation_evaluate);
+}
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GenericCircuit.hpp"
+#include "CircuitFromShMem.h"
+#include "ProvenanceMapping.h"
+#include "UserSemiring.h"
+#include "provsql_utils_cpp.h"
+
+using namespace std;
+
+// Value of a semimod gate: the semimodule function applied to the
+// textual value of its value gate (NULL for the value gate of a NULL
+// value) and to the evaluation of its provenance over the semiring
+static DatumValue evaluate_semimod(
+  const GenericCircuit &c,
+  gate_t g,
+  UserSemiring &semiring,
+  FmgrFunction &semimod,
+  unordered_map<gate_t, DatumValue> &memo)
+{
+  const auto &children = c.getWires(g);
+  if(children.size() != 2)
+    throw CircuitException("Incorrect number of children for semimod gate");
+
+  DatumValue provenance = c.evaluate(children[0], semiring, &memo);
+  DatumValue value{(Datum) 0, true};
+  if(c.isKnown(children[1]) && c.getGateType(children[1]) == gate_value &&
+     !c.isNullExtra(children[1])) {
+    value.value = PointerGetDatum(cstring_to_text(c.getExtra(children[1]).c_str()));
+    value.isnull = false;
+  }
+
+  return semimod({value, provenance});
+}
+
+static Datum aggregation_evaluate_internal(
+  FunctionCallInfo fcinfo,
+  pg_uuid_t token,
+  Oid token2value,
+  Oid agg_function_final,
+  Oid agg_function,
+  Oid semimod_function,
+  Oid element_type,
+  Datum element_one,
+  Oid plus_function,
+  Oid times_function,
+  Oid monus_function,
+  Oid delta_function)
+{
+  GenericCircuit c = createGenericCircuit(token);
+  gate_t gate = c.getGate(uuid2string(token));
+
+  // Only agg and semimod gates have a value in the semimodule; this
+  // includes the zero gate used for aggregates over no tuple
+  if(!c.isKnown(gate) || (c.getGateType(gate) != gate_agg && c.getGateType(gate) != gate_semimod))
+    PG_RETURN_NULL();
+
+  ProvenanceMapping mapping(token2value, CurrentMemoryContext);
+  MemoryContext caller_context = CurrentMemoryContext;
+  Oid collation = PG_GET_COLLATION();
+  DatumValue result;
+  int16 typlen;
+  bool typbyval;
+
+  get_typlenbyval(element_type, &typlen, &typbyval);
+
+  SPI_connect();
+
+  try {
+    UserSemiring semiring(c, mapping, element_type, {element_one, false},
+                          plus_function, times_function, monus_function, delta_function,
+                          collation);
+    FmgrFunction semimod(semimod_function, {VARCHAROID, element_type}, element_type, collation);
+    // Provenance subcircuits shared by several semimod gates are only
+    // evaluated once
+    unordered_map<gate_t, DatumValue> memo;
+
+    if(c.getGateType(gate) == gate_semimod)
+      result = evaluate_semimod(c, gate, semiring, semimod, memo);
+    else if(c.getWires(gate).empty())
+      result = {(Datum) 0, true};
+    else {
+      Oid agg_type = get_func_rettype(agg_function);
+      if(IsPolymorphicType(agg_type))
+        agg_type = element_type;
+
+      PGAggregate agg(agg_function, element_type, collation);
+      FmgrFunction finalize(agg_function_final, {agg_type, VARCHAROID}, element_type, collation);
+      vector<DatumValue> values;
+
+      for(auto child: c.getWires(gate))
+        values.push_back(evaluate_semimod(c, child, semiring, semimod, memo));
+
+      // Name of the aggregate function of the original query, as
+      // recorded by provenance_aggregate
+      const char *name = get_func_name(c.getInfos(gate).first);
+      if(!name)
+        throw CircuitException("Unknown aggregate function in agg gate");
+
+      result = finalize({agg(values), {PointerGetDatum(cstring_to_text(name)), false}});
+    }
+  } catch(CircuitException &e) {
+    elog(ERROR, "%s", e.what());
+  }
+
+  // The result is moved out of SPI memory before it is released
+  if(!result.isnull) {
+    MemoryContext spi_context = MemoryContextSwitchTo(caller_context);
+    result.value = datumCopy(result.value, typbyval, typlen);
+    MemoryContextSwitchTo(spi_context);
+  }
+
+  SPI_finish();
+
+  if(result.isnull)
+    PG_RETURN_NULL();
+  else
+    PG_RETURN_DATUM(result.value);
+}
+
+Datum aggregation_evaluate(PG_FUNCTION_ARGS)
+{
+  for(unsigned i=0; i<8; ++i)
+    if(PG_ARGISNULL(i))
+      PG_RETURN_NULL();
+
+  return aggregation_evaluate_internal(
+    fcinfo,
+    *DatumGetUUIDP(PG_GETARG_DATUM(0)),
+    PG_GETARG_OID(1),
+    PG_GETARG_OID(2),
+    PG_GETARG_OID(3),
+    PG_GETARG_OID(4),
+    get_fn_expr_argtype(fcinfo->flinfo, 5),
+    PG_GETARG_DATUM(5),
+    PG_GETARG_OID(6),
+    PG_GETARG_OID(7),
+    PG_ARGISNULL(8)?InvalidOid:PG_GETARG_OID(8),
+    PG_ARGISNULL(9)?InvalidOid:PG_GETARG_OID(9));
+}
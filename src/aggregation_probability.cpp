@@ -0,0 +1,313 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#if PG_VERSION_NUM >= 110000
+#include "utils/regproc.h"
+#endif
+#include "utils/uuid.h"
+#include "executor/spi.h"
+#include "provsql_shmem.h"
+#include "provsql_utils.h"
+
+PG_FUNCTION_INFO_V1(expected_value);
+PG_FUNCTION_INFO_V1(count_distribution);
+}
+
+#include <stack>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "BooleanCircuit.h"
+#include "CircuitFromShMem.h"
+#include "GenericCircuit.h"
+#include "dDNNF.h"
+#include "provsql_utils_cpp.h"
+
+using namespace std;
+
+// Aggregate over a group, as represented by an agg gate: each semimod
+// child contributes value to the aggregate when provenance holds
+struct AggregateTerms {
+  string function;
+  vector<pg_uuid_t> provenance;
+  vector<double> values;
+};
+
+static AggregateTerms read_aggregate(pg_uuid_t token)
+{
+  GenericCircuit c = createGenericCircuit(token);
+  gate_t gate = c.getGate(uuid2string(token));
+  AggregateTerms result;
+
+  // Aggregates over no tuple are represented by the zero gate
+  if(c.isKnown(gate) && c.getGateType(gate) == gate_zero)
+    return result;
+
+  if(!c.isKnown(gate) || c.getGateType(gate) != gate_agg)
+    throw CircuitException("Token is not an aggregation token");
+
+  Oid aggfnoid = c.getInfos(gate).first;
+  const char *name = get_func_name(aggfnoid);
+  if(!name)
+    throw CircuitException("Unknown aggregate function in agg gate");
+  // Aggregates other than built-in ones are designated by their full
+  // signature, so as not to be taken for a built-in aggregate
+  if(get_func_namespace(aggfnoid) == PG_CATALOG_NAMESPACE)
+    result.function = name;
+  else
+    result.function = format_procedure(aggfnoid);
+
+  for(auto s: c.getWires(gate)) {
+    if(!c.isKnown(s) || c.getGateType(s) != gate_semimod || c.getWires(s).size() != 2)
+      throw CircuitException("Incorrect child of agg gate");
+
+    gate_t value = c.getWires(s)[1];
+    double v = 0.;
+    // NULL values do not contribute to the aggregate
+    if(c.isKnown(value) && !c.getExtra(value).empty())
+      v = stod(c.getExtra(value));
+
+    result.provenance.push_back(string2uuid(c.getUUID(c.getWires(s)[0])));
+    result.values.push_back(v);
+  }
+
+  return result;
+}
+
+static double probability(BooleanCircuit &c, gate_t g, bool &rewritten)
+{
+  double result;
+
+  if(!rewritten) {
+    try {
+      return c.independentEvaluation(g);
+    } catch(CircuitException &) {}
+
+    c.rewriteMultivaluedGates();
+    rewritten = true;
+  }
+
+  result = c.makeDD(g, "", "").probabilityEvaluation();
+
+  // Avoid rounding errors that make probability outside of [0,1]
+  if(result>1.)
+    result=1.;
+  else if(result<0.)
+    result=0.;
+
+  return result;
+}
+
+// Probabilities of each of the roots of the circuit, computed once per
+// distinct root
+static vector<double> probabilities(BooleanCircuit &c, const vector<gate_t> &roots, bool &rewritten)
+{
+  unordered_map<gate_t, double> computed;
+  vector<double> result;
+
+  for(auto g: roots) {
+    auto it = computed.find(g);
+    if(it == computed.end())
+      it = computed.emplace(g, probability(c, g, rewritten)).first;
+    result.push_back(it->second);
+  }
+
+  return result;
+}
+
+Datum expected_value(PG_FUNCTION_ARGS)
+{
+  try {
+    if(PG_ARGISNULL(0))
+      PG_RETURN_NULL();
+
+    AggregateTerms agg = read_aggregate(*DatumGetUUIDP(PG_GETARG_DATUM(0)));
+
+    if(agg.provenance.empty())
+      PG_RETURN_NULL();
+
+    if(agg.function != "sum" && agg.function != "count")
+      elog(ERROR, "Expected value of aggregate %s not supported, only sum and count are", agg.function.c_str());
+
+    // By linearity of expectation, the expected value is the sum of
+    // the values weighted by the probability of their provenance
+    BooleanCircuit c = createBooleanCircuit(agg.provenance);
+    vector<gate_t> roots;
+    for(const auto &t: agg.provenance)
+      roots.push_back(c.getGate(uuid2string(t)));
+
+    bool rewritten = false;
+    vector<double> probs = probabilities(c, roots, rewritten);
+
+    double result = 0.;
+    for(unsigned i=0; i<probs.size(); ++i)
+      result += probs[i] * agg.values[i];
+
+    PG_RETURN_FLOAT8(result);
+  } catch(const std::exception &e) {
+    elog(ERROR, "expected_value: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "expected_value: Unknown exception");
+  }
+
+  PG_RETURN_NULL();
+}
+
+// Variables (input gates, and keys of multivalued inputs) a gate
+// depends on
+static unordered_set<gate_t> variables(const BooleanCircuit &c, gate_t root)
+{
+  stack<gate_t> to_process;
+  unordered_set<gate_t> processed, result;
+  to_process.push(root);
+
+  while(!to_process.empty()) {
+    gate_t g = to_process.top();
+    to_process.pop();
+
+    if(!processed.insert(g).second)
+      continue;
+
+    auto t = c.getGateType(g);
+    if(t == BooleanGate::IN || t == BooleanGate::MULVAR)
+      result.insert(g);
+    else
+      for(auto child: c.getWires(g))
+        to_process.push(child);
+  }
+
+  return result;
+}
+
+static unsigned find_component(vector<unsigned> &parent, unsigned i)
+{
+  while(parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+// Distribution of the number of roots that are true, when they
+// (may) share variables: a single d-DNNF is compiled for the
+// equivalence of each root with a fresh indicator input gate (see
+// BooleanCircuit::addIndicatorGates), over which the distribution of
+// the number of true indicators is computed in one pass
+static vector<double> correlated_distribution(BooleanCircuit &c, const vector<gate_t> &roots)
+{
+  vector<gate_t> indicators;
+  gate_t g = c.addIndicatorGates(roots, indicators);
+  dDNNF dd = c.makeDD(g, "", "", true);
+
+  unordered_set<gate_t> counted;
+  for(auto y: indicators) {
+    if(!dd.hasGate(c.getUUID(y)))
+      throw CircuitException("Indicator gate missing from d-DNNF");
+    counted.insert(dd.getGate(c.getUUID(y)));
+  }
+
+  vector<double> result = dd.countDistribution(counted);
+  result.resize(roots.size()+1, 0.);
+  for(auto &p: result)
+    p = p<0. ? 0. : (p>1. ? 1. : p);
+
+  return result;
+}
+
+Datum count_distribution(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+  MemoryContext per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+  MemoryContext oldcontext    = MemoryContextSwitchTo(per_query_ctx);
+
+  TupleDesc tupdesc = rsinfo->expectedDesc;
+  Tuplestorestate *tupstore     = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+
+  try {
+    if(!PG_ARGISNULL(0)) {
+      AggregateTerms agg = read_aggregate(*DatumGetUUIDP(PG_GETARG_DATUM(0)));
+
+      if(!agg.provenance.empty() && agg.function != "count")
+        elog(ERROR, "Count distribution of aggregate %s not supported, only count is", agg.function.c_str());
+
+      // Distribution of the count, starting from the empty group
+      vector<double> distribution{1.};
+
+      if(!agg.provenance.empty()) {
+        BooleanCircuit c = createBooleanCircuit(agg.provenance);
+        vector<gate_t> roots;
+        for(const auto &t: agg.provenance)
+          roots.push_back(c.getGate(uuid2string(t)));
+
+        // Roots are grouped into components of roots sharing
+        // variables; components are independent of each other
+        vector<unsigned> parent(roots.size());
+        unordered_map<gate_t, unsigned> variable2root;
+        for(unsigned i=0; i<roots.size(); ++i)
+          parent[i] = i;
+        for(unsigned i=0; i<roots.size(); ++i)
+          for(auto v: variables(c, roots[i])) {
+            auto it = variable2root.find(v);
+            if(it == variable2root.end())
+              variable2root[v] = i;
+            else
+              parent[find_component(parent, i)] = find_component(parent, it->second);
+          }
+
+        unordered_map<unsigned, vector<gate_t> > components;
+        for(unsigned i=0; i<roots.size(); ++i)
+          components[find_component(parent, i)].push_back(roots[i]);
+
+        bool rewritten = false;
+        for(const auto &p: components) {
+          vector<double> component_distribution;
+
+          if(p.second.size() == 1) {
+            double prob = probability(c, p.second[0], rewritten);
+            component_distribution = {1.-prob, prob};
+          } else {
+            if(!rewritten) {
+              c.rewriteMultivaluedGates();
+              rewritten = true;
+            }
+            component_distribution = correlated_distribution(c, p.second);
+          }
+
+          vector<double> product(distribution.size()+component_distribution.size()-1, 0.);
+          for(unsigned i=0; i<distribution.size(); ++i)
+            for(unsigned j=0; j<component_distribution.size(); ++j)
+              product[i+j] += distribution[i]*component_distribution[j];
+          distribution = std::move(product);
+        }
+      }
+
+      for(unsigned k=0; k<distribution.size(); ++k) {
+        Datum values[2] = {
+          Int64GetDatum(k), Float8GetDatum(distribution[k])
+        };
+        bool nulls[sizeof(values)] = {0, 0};
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+      }
+    }
+  } catch(const std::exception &e) {
+    elog(ERROR, "count_distribution: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "count_distribution: Unknown exception");
+  }
+
+  tuplestore_donestoring(tupstore);
+  MemoryContextSwitchTo(oldcontext);
+
+  PG_RETURN_NULL();
+}
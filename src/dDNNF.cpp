@@ -2,10 +2,13 @@
 
 #include <unordered_map>
 #include <stack>
-#include <variant>
+#include <queue>
 #include <cassert>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
+#include <iterator>
+#include <memory>
 
 std::unordered_set<gate_t> dDNNF::vars(gate_t root) const
 {
@@ -35,55 +38,152 @@ std::unordered_set<gate_t> dDNNF::vars(gate_t root) const
   return result;
 }
 
+gate_t dDNNF::addGate()
+{
+  invalidateEvaluationOrder();
+  return BooleanCircuit::addGate();
+}
+
+gate_t dDNNF::setGate(BooleanGate t)
+{
+  invalidateEvaluationOrder();
+  return BooleanCircuit::setGate(t);
+}
+
+gate_t dDNNF::setGate(const uuid &u, BooleanGate t)
+{
+  invalidateEvaluationOrder();
+  return BooleanCircuit::setGate(u, t);
+}
+
+void dDNNF::addWire(gate_t f, gate_t t)
+{
+  invalidateEvaluationOrder();
+  BooleanCircuit::addWire(f, t);
+}
+
+void dDNNF::setGateType(gate_t g, BooleanGate t)
+{
+  invalidateEvaluationOrder();
+  BooleanCircuit::setGateType(g, t);
+}
+
 void dDNNF::makeSmooth()
 {
-  gate_t original_gates_size{gates.size()};
-  // gates.size() might change in the loop, but newly added gates do not
-  // need to be iterated upon
+  invalidateEvaluationOrder();
+  const gate_t original_gates_size{gates.size()};
+  // gates.size() changes during smoothing, but newly added gates do not
+  // need to be smoothed
+  const auto index = [](gate_t g) {
+                       return static_cast<std::underlying_type<gate_t>::type>(g);
+                     };
+
+  // Variables of each gate, as sorted vectors, computed once bottom-up;
+  // a gate with the same variables as one of its children shares the
+  // vector of this child. Smoothing an OR gate does not change its
+  // variables, so these vectors remain valid during smoothing.
+  std::vector<std::shared_ptr<const std::vector<gate_t> > > varss(index(original_gates_size));
+  const auto no_vars = std::make_shared<const std::vector<gate_t> >();
+
+  // Gate (v OR NOT v) for each variable v, created once and shared by
+  // all gates that need to be smoothed with respect to v
+  std::unordered_map<gate_t, gate_t> smoothing_gates;
+  const auto smoothing_gate = [&](gate_t v) {
+                                auto it = smoothing_gates.find(v);
+                                if(it == smoothing_gates.end()) {
+                                  gate_t dummy_or_gate = setGate(BooleanGate::OR);
+                                  gate_t dummy_not_gate = setGate(BooleanGate::NOT);
+                                  addWire(dummy_or_gate, v);
+                                  addWire(dummy_not_gate, v);
+                                  addWire(dummy_or_gate, dummy_not_gate);
+                                  it = smoothing_gates.emplace(v, dummy_or_gate).first;
+                                }
+                                return it->second;
+                              };
+
+  // Depth-first traversal, processing each gate after its children;
+  // in the stack, b indicates whether this is the beginning (false) or
+  // ending (true) of the processing of a gate
+  std::vector<bool> visited(index(original_gates_size), false);
+  std::stack<std::pair<gate_t, bool> > stack;
 
-  for(gate_t g = gate_t{0}; g<original_gates_size; ++g) {
-    if(getGateType(g)!=BooleanGate::OR || getWires(g).size()<=1)
+  for(gate_t start{0}; start<original_gates_size; ++start) {
+    if(visited[index(start)])
       continue;
 
-    std::unordered_set<gate_t> all;
-    std::vector<std::unordered_set<gate_t> > varss;
-
-    std::for_each(getWires(g).begin(), getWires(g).end(),
-                  [&](gate_t g) {
-      varss.push_back(vars(g));
-    });
-    std::for_each(varss.begin(), varss.end(),
-                  [&](const auto &s) {
-      all.insert(s.begin(),s.end());
-    });
-
-    for(auto v: all) {
-      bool modified = false;
-      for(size_t i=0; i<varss.size(); ++i) {
-        if(varss[i].find(v)==varss[i].end()) {
-          if(!modified) {
-            if(getGateType(getWires(g)[i])!=BooleanGate::AND) {
-              gate_t and_gate = setGate(BooleanGate::AND);
-              addWire(and_gate, getWires(g)[i]);
-              getWires(g)[i]=and_gate;
-            }
-            modified = true;
-          }
-
-          gate_t dummy_or_gate = setGate(BooleanGate::OR);
-          gate_t dummy_not_gate = setGate(BooleanGate::NOT);
-          addWire(dummy_or_gate, v);
-          addWire(dummy_not_gate, v);
-          addWire(dummy_or_gate, dummy_not_gate);
-          addWire(getWires(g)[i],dummy_or_gate);
+    stack.emplace(start, false);
+    while(!stack.empty()) {
+      auto [g, b] = stack.top();
+      stack.pop();
+
+      if(!b) {
+        if(visited[index(g)])
+          continue;
+        visited[index(g)] = true;
+        stack.emplace(g, true);
+        for(auto c: getWires(g))
+          if(!visited[index(c)])
+            stack.emplace(c, false);
+        continue;
+      }
+
+      // Copy, as adding gates invalidates references to wires
+      const std::vector<gate_t> children = getWires(g);
+
+      if(getGateType(g) == BooleanGate::IN) {
+        varss[index(g)] = std::make_shared<const std::vector<gate_t> >(1, g);
+        continue;
+      } else if(children.empty()) {
+        varss[index(g)] = no_vars;
+        continue;
+      }
+
+      bool same = true;
+      for(auto c: children)
+        if(varss[index(c)] != varss[index(children[0])]) {
+          same = false;
+          break;
         }
+      if(same) {
+        varss[index(g)] = varss[index(children[0])];
+        continue;
       }
+
+      std::vector<gate_t> all;
+      for(auto c: children)
+        all.insert(all.end(), varss[index(c)]->begin(), varss[index(c)]->end());
+      std::sort(all.begin(), all.end());
+      all.erase(std::unique(all.begin(), all.end()), all.end());
+
+      if(getGateType(g) == BooleanGate::OR) {
+        for(size_t i=0; i<children.size(); ++i) {
+          const auto &child_vars = *varss[index(children[i])];
+          if(child_vars.size() == all.size())
+            continue;
+
+          std::vector<gate_t> missing;
+          std::set_difference(all.begin(), all.end(),
+                              child_vars.begin(), child_vars.end(),
+                              std::back_inserter(missing));
+
+          // The child is wrapped in a new AND gate rather than modified,
+          // since it may have other parents
+          gate_t and_gate = setGate(BooleanGate::AND);
+          addWire(and_gate, children[i]);
+          for(auto v: missing)
+            addWire(and_gate, smoothing_gate(v));
+          getWires(g)[i] = and_gate;
+        }
+      }
+
+      varss[index(g)] = std::make_shared<const std::vector<gate_t> >(std::move(all));
     }
   }
 }
 
 void dDNNF::makeGatesBinary(BooleanGate type)
 {
+  invalidateEvaluationOrder();
   for(gate_t g{0}; g<gates.size(); ++g) {
     if(getGateType(g)!=type || getWires(g).size()<=2)
       continue;
@@ -115,84 +215,683 @@ void dDNNF::makeGatesBinary(BooleanGate type)
   }
 }
 
+const dDNNF::EvaluationOrder &dDNNF::evaluationOrder() const
+{
+  if(evaluation_order.nb_gates == gates.size() && evaluation_order.root == root &&
+     !evaluation_order.gates.empty())
+    return evaluation_order;
+
+  EvaluationOrder &order = evaluation_order;
+  order.root = root;
+  order.nb_gates = gates.size();
+  order.gates.clear();
+  order.first_child.clear();
+  order.children.clear();
+
+  if(gates.size() == 0)
+    return order;
+
+  // Depth-first traversal from the root: contains a pair (node, b) where
+  // b indicates whether this is the beginning (false) or ending (true)
+  // of the processing of a node
+  std::vector<bool> seen(gates.size(), false);
+  std::stack<std::pair<gate_t, bool> > stack;
+  stack.emplace(std::make_pair(root, false));
+
+  while(!stack.empty())
+  {
+    auto [node, b] = stack.top();
+    stack.pop();
+
+    if(b) {
+      order.gates.push_back(node);
+      continue;
+    }
+
+    if(seen[static_cast<size_t>(node)])
+      continue;
+    seen[static_cast<size_t>(node)] = true;
+
+    stack.push(std::make_pair(node, true));
+    for(auto c: getWires(node))
+      stack.push(std::make_pair(c, false));
+  }
+
+  std::vector<size_t> position(gates.size());
+  for(size_t i=0; i<order.gates.size(); ++i)
+    position[static_cast<size_t>(order.gates[i])] = i;
+
+  order.first_child.reserve(order.gates.size()+1);
+  for(auto g: order.gates) {
+    order.first_child.push_back(order.children.size());
+    for(auto c: getWires(g))
+      order.children.push_back(position[static_cast<size_t>(c)]);
+  }
+  order.first_child.push_back(order.children.size());
+
+  return order;
+}
+
+std::vector<double> dDNNF::gateProbabilities(double scale) const
+{
+  const auto &order = evaluationOrder();
+  const size_t *children = order.children.data();
+  std::vector<double> result(order.gates.size());
+
+  // Children come before their parents, so that a single sweep suffices
+  for(size_t i=0; i<order.gates.size(); ++i) {
+    const size_t begin = order.first_child[i];
+    const size_t end = order.first_child[i+1];
+    double value;
+
+    switch(getGateType(order.gates[i])) {
+    case BooleanGate::IN:
+      value = scale*getProb(order.gates[i]);
+      break;
+    case BooleanGate::NOT:
+      value = 1-result[children[begin]];
+      break;
+    case BooleanGate::AND:
+      value = 1.;
+      for(size_t j=begin; j<end; ++j)
+        value *= result[children[j]];
+      break;
+    case BooleanGate::OR:
+      value = 0.;
+      for(size_t j=begin; j<end; ++j)
+        value += result[children[j]];
+      break;
+    default:
+      throw CircuitException("Incorrect gate type");
+    }
+
+    result[i] = value;
+  }
+
+  return result;
+}
+
 double dDNNF::probabilityEvaluation() const
 {
   if (gates.size() == 0)
     return 0.;
 
-  // Unfortunately, dDNNFs can be quite deep so we need to simulate
-  // recursion with a heap-based stack, to avoid exhausting the actual
-  // memory stack
-  using RecursionParams = struct {
-    gate_t g;
-    size_t children_processed;
-    double partial_value;
-  };
-  using RecursionResult = double;
-  std::stack<std::variant<RecursionParams,RecursionResult> > stack;
-  stack.emplace(RecursionParams{root,0,0.});
-
-  while(1) {
-    double child_value{0.};
-
-    if(stack.top().index()==1) {   // RecursionResult
-      child_value=std::get<1>(stack.top());
-      stack.pop();
+  // The root is the last gate of the evaluation order
+  return gateProbabilities().back();
+}
+
+std::vector<double> dDNNF::probabilityEvaluation(
+  size_t nb_scenarios,
+  const std::unordered_map<gate_t, std::vector<double> > &probabilities) const
+{
+  if (gates.size() == 0)
+    return std::vector<double>(nb_scenarios, 0.);
+
+  const auto &order = evaluationOrder();
+  const size_t *children = order.children.data();
+  const size_t K = nb_scenarios;
+
+  // The K values of each gate are contiguous, so that the operations of
+  // a gate are applied to all scenarios in vectorizable loops
+  std::vector<double> values(order.gates.size()*K);
+
+  for(size_t i=0; i<order.gates.size(); ++i) {
+    const gate_t g = order.gates[i];
+    const size_t begin = order.first_child[i];
+    const size_t end = order.first_child[i+1];
+    double *v = values.data()+i*K;
+
+    switch(getGateType(g)) {
+    case BooleanGate::IN:
+    {
+      auto it = probabilities.find(g);
+      if(it == probabilities.end())
+        std::fill(v, v+K, getProb(g));
+      else
+        std::copy(it->second.begin(), it->second.begin()+K, v);
+      break;
+    }
+    case BooleanGate::NOT:
+    {
+      const double *c = values.data()+children[begin]*K;
+      for(size_t s=0; s<K; ++s)
+        v[s] = 1-c[s];
+      break;
+    }
+    case BooleanGate::AND:
+      std::fill(v, v+K, 1.);
+      for(size_t j=begin; j<end; ++j) {
+        const double *c = values.data()+children[j]*K;
+        for(size_t s=0; s<K; ++s)
+          v[s] *= c[s];
+      }
+      break;
+    case BooleanGate::OR:
+      std::fill(v, v+K, 0.);
+      for(size_t j=begin; j<end; ++j) {
+        const double *c = values.data()+children[j]*K;
+        for(size_t s=0; s<K; ++s)
+          v[s] += c[s];
+      }
+      break;
+    default:
+      throw CircuitException("Incorrect gate type");
     }
+  }
 
-    auto [g, children_processed, partial_value]=std::get<0>(stack.top());
-    stack.pop();
+  return std::vector<double>(values.end()-K, values.end());
+}
+
+std::unordered_map<gate_t, double> dDNNF::probabilityGradient(double scale) const
+{
+  std::unordered_map<gate_t, double> result;
+
+  if (gates.size() == 0)
+    return result;
+
+  const auto &order = evaluationOrder();
+  const auto probability = gateProbabilities(scale);
 
-    auto it = probability_cache.find(g);
+  // Reverse-mode differentiation: the adjoint of a gate is the partial
+  // derivative of the probability of the root with respect to the
+  // probability of this gate; since OR gates are deterministic and AND
+  // gates decomposable, the probability is multilinear in those of the
+  // children of each gate
+  std::vector<double> adjoint(order.gates.size(), 0.);
+  adjoint.back() = 1.;
 
-    if(it!=probability_cache.end()) {
-      if(stack.empty())
-        return it->second;
+  for(size_t i=order.gates.size(); i-->0;) {
+    gate_t g = order.gates[i];
+    double a = adjoint[i];
+    const size_t *w = order.children.data()+order.first_child[i];
+    const size_t n = order.first_child[i+1]-order.first_child[i];
+
+    switch(getGateType(g)) {
+    case BooleanGate::IN:
+      result[g] = a;
+      break;
+
+    case BooleanGate::NOT:
+      adjoint[w[0]] -= a;
+      break;
+
+    case BooleanGate::OR:
+      for(size_t j=0; j<n; ++j)
+        adjoint[w[j]] += a;
+      break;
+
+    case BooleanGate::AND:
+    {
+      // Products of the probabilities of the other children, through
+      // prefix and suffix products to avoid divisions by zero
+      std::vector<double> suffix(n+1, 1.);
+      for(size_t j=n; j>0; --j)
+        suffix[j-1] = suffix[j] * probability[w[j-1]];
+      double prefix = 1.;
+      for(size_t j=0; j<n; ++j) {
+        adjoint[w[j]] += a * prefix * suffix[j+1];
+        prefix *= probability[w[j]];
+      }
+      break;
+    }
+
+    case BooleanGate::MULIN:
+    case BooleanGate::MULVAR:
+    case BooleanGate::UNDETERMINED:
+      throw CircuitException("Incorrect gate type");
+      break;
+    }
+  }
+
+  return result;
+}
+
+std::vector<double> dDNNF::countDistribution(const std::unordered_set<gate_t> &counted) const
+{
+  if (gates.size() == 0)
+    return {};
+
+  const auto &order = evaluationOrder();
+  const size_t *children = order.children.data();
+
+  // Polynomial of each gate, as its coefficients: the coefficient of
+  // degree k is the probability that the gate holds with k of the
+  // counted input gates under it true. Since AND gates are
+  // decomposable, their polynomial is the product of those of their
+  // children; since OR gates are deterministic, it is the sum.
+  std::vector<std::vector<double> > values(order.gates.size());
+
+  for(size_t i=0; i<order.gates.size(); ++i) {
+    const gate_t g = order.gates[i];
+    const size_t begin = order.first_child[i];
+    const size_t end = order.first_child[i+1];
+    auto &v = values[i];
+
+    switch(getGateType(g)) {
+    case BooleanGate::IN:
+      if(counted.find(g) != counted.end())
+        v = {0., 1.};
       else
-        stack.emplace(it->second);
-    } else {
-      if(children_processed==0) {
-        switch(getGateType(g)) {
-        case BooleanGate::IN:
-          partial_value = getProb(g);
-          break;
-        case BooleanGate::NOT:
-          partial_value = 1-getProb(*getWires(g).begin());
-          break;
-        case BooleanGate::AND:
-          partial_value = 1;
-          break;
-        case BooleanGate::OR:
-          partial_value = 0;
-          break;
-        default:
-          assert(false);
+        v = {getProb(g)};
+      break;
+
+    case BooleanGate::NOT:
+    {
+      gate_t in = order.gates[children[begin]];
+      if(getGateType(in) != BooleanGate::IN)
+        throw CircuitException("NOT gates of the d-DNNF should be over input gates");
+      if(counted.find(in) != counted.end())
+        v = {1.};
+      else
+        v = {1.-getProb(in)};
+      break;
+    }
+
+    case BooleanGate::AND:
+      v = {1.};
+      for(size_t j=begin; j<end; ++j) {
+        const auto &c = values[children[j]];
+        std::vector<double> product(v.size()+c.size()-1, 0.);
+        for(size_t k=0; k<v.size(); ++k)
+          for(size_t l=0; l<c.size(); ++l)
+            product[k+l] += v[k]*c[l];
+        v = std::move(product);
+      }
+      break;
+
+    case BooleanGate::OR:
+      v = {0.};
+      for(size_t j=begin; j<end; ++j) {
+        const auto &c = values[children[j]];
+        if(c.size() > v.size())
+          v.resize(c.size(), 0.);
+        for(size_t k=0; k<c.size(); ++k)
+          v[k] += c[k];
+      }
+      break;
+
+    default:
+      throw CircuitException("Incorrect gate type");
+    }
+  }
+
+  return values.back();
+}
+
+// Logarithm of the ratio between the probability of a literal and that
+// of the most probable literal over the same input gate
+static double literal_log_ratio(double p, bool value)
+{
+  return std::log(value ? p : 1-p) - std::log(std::max(p, 1-p));
+}
+
+dDNNF::Explanation dDNNF::mostProbableExplanation() const
+{
+  Explanation result{0., {}};
+
+  if (gates.size() == 0)
+    return result;
+
+  const auto &order = evaluationOrder();
+  const size_t *children = order.children.data();
+
+  // For each gate, logarithm of the ratio between the probability of
+  // the most probable assignment of its variables satisfying it and
+  // the probability of the most probable assignment of these variables.
+  // Ratios are multiplied over (decomposable) AND gates, and maximized
+  // over OR gates: a variable missing from a child of an OR gate takes
+  // its most probable value, which does not change the ratio, so that
+  // the d-DNNF does not need to be smooth.
+  std::vector<double> best(order.gates.size());
+  // Child of each OR gate achieving the maximum
+  std::vector<size_t> choice(order.gates.size());
+
+  for(size_t i=0; i<order.gates.size(); ++i) {
+    const gate_t g = order.gates[i];
+    const size_t begin = order.first_child[i];
+    const size_t end = order.first_child[i+1];
+
+    switch(getGateType(g)) {
+    case BooleanGate::IN:
+      best[i] = literal_log_ratio(getProb(g), true);
+      break;
+
+    case BooleanGate::NOT:
+    {
+      const gate_t c = order.gates[children[begin]];
+      if(getGateType(c) != BooleanGate::IN)
+        throw CircuitException("NOT gates of the d-DNNF should be over input gates");
+      best[i] = literal_log_ratio(getProb(c), false);
+      break;
+    }
+
+    case BooleanGate::AND:
+      best[i] = 0.;
+      for(size_t j=begin; j<end; ++j)
+        best[i] += best[children[j]];
+      break;
+
+    case BooleanGate::OR:
+      best[i] = -INFINITY;
+      for(size_t j=begin; j<end; ++j)
+        if(best[children[j]] > best[i]) {
+          best[i] = best[children[j]];
+          choice[i] = children[j];
         }
+      break;
+
+    case BooleanGate::MULIN:
+    case BooleanGate::MULVAR:
+    case BooleanGate::UNDETERMINED:
+      throw CircuitException("Incorrect gate type");
+    }
+  }
+
+  if(best.back() == -INFINITY)
+    return result;
+
+  // Traceback from the root, following the best child of OR gates
+  std::unordered_map<gate_t, bool> assignment;
+  std::vector<bool> visited(order.gates.size(), false);
+  std::stack<size_t> to_process;
+  to_process.push(order.gates.size()-1);
+
+  while(!to_process.empty()) {
+    size_t i = to_process.top();
+    to_process.pop();
+
+    if(visited[i])
+      continue;
+    visited[i] = true;
+
+    const gate_t g = order.gates[i];
+    const size_t begin = order.first_child[i];
+    const size_t end = order.first_child[i+1];
+
+    switch(getGateType(g)) {
+    case BooleanGate::IN:
+      assignment[g] = true;
+      break;
+    case BooleanGate::NOT:
+      assignment[order.gates[children[begin]]] = false;
+      break;
+    case BooleanGate::AND:
+      for(size_t j=begin; j<end; ++j)
+        to_process.push(children[j]);
+      break;
+    case BooleanGate::OR:
+      to_process.push(choice[i]);
+      break;
+    default:
+      break;
+    }
+  }
+
+  result.probability = 1.;
+  for(auto var: inputs) {
+    double p = getProb(var);
+    auto it = assignment.find(var);
+    bool value = it == assignment.end() ? p > 1-p : it->second;
+
+    result.probability *= value ? p : 1-p;
+    if(value)
+      result.inputs.push_back(var);
+  }
+
+  return result;
+}
+
+// Candidate world of a gate in the k-best dynamic programming of
+// dDNNF::topKExplanations: its log-probability, and how it is obtained
+// from the candidates of the children of the gate (ranks of the
+// candidates of the children for AND gates, index of the child and rank
+// of its candidate for OR gates)
+struct KBestCandidate {
+  double value;
+  size_t first;
+  size_t second;
+};
+
+static bool operator<(const KBestCandidate &c1, const KBestCandidate &c2)
+{
+  return c1.value < c2.value;
+}
+
+std::vector<dDNNF::Explanation> dDNNF::topKExplanations(unsigned k) const
+{
+  std::vector<Explanation> result;
+
+  if (gates.size() == 0 || k == 0)
+    return result;
+
+  // Distinct derivations of a smooth d-DNNF correspond to distinct
+  // worlds over the variables of the root
+  dDNNF d = *this;
+  d.makeSmooth();
+  d.makeGatesBinary(BooleanGate::AND);
+
+  const auto &order = d.evaluationOrder();
+  const size_t *children = order.children.data();
+
+  // Best candidates of each gate, by decreasing value
+  std::vector<std::vector<KBestCandidate> > best(order.gates.size());
+
+  for(size_t i=0; i<order.gates.size(); ++i) {
+    const gate_t g = order.gates[i];
+    const size_t begin = order.first_child[i];
+    const size_t n = order.first_child[i+1]-begin;
+    auto &b = best[i];
+
+    switch(d.getGateType(g)) {
+    case BooleanGate::IN:
+      if(d.getProb(g) > 0.)
+        b.push_back({std::log(d.getProb(g)), 0, 0});
+      break;
+
+    case BooleanGate::NOT:
+    {
+      const gate_t c = order.gates[children[begin]];
+      if(d.getGateType(c) != BooleanGate::IN)
+        throw CircuitException("NOT gates of the d-DNNF should be over input gates");
+      if(d.getProb(c) < 1.)
+        b.push_back({std::log(1-d.getProb(c)), 0, 0});
+      break;
+    }
+
+    case BooleanGate::AND:
+      if(n == 0)
+        b.push_back({0., 0, 0});
+      else if(n == 1) {
+        const auto &b0 = best[children[begin]];
+        for(size_t r=0; r<b0.size(); ++r)
+          b.push_back({b0[r].value, r, 0});
       } else {
-        if(getGateType(g) == BooleanGate::AND) {
-          partial_value *= child_value;
-        } else {   // BooleanGate::OR
-          partial_value += child_value;
+        // Best sums of a candidate of each child, (r0, r1+1) being
+        // considered after (r0, r1), and (r0+1, 0) after (r0, 0), so
+        // that no pair is considered twice
+        const auto &b0 = best[children[begin]];
+        const auto &b1 = best[children[begin+1]];
+        std::priority_queue<KBestCandidate> queue;
+        if(!b0.empty() && !b1.empty())
+          queue.push({b0[0].value+b1[0].value, 0, 0});
+        while(!queue.empty() && b.size()<k) {
+          auto c = queue.top();
+          queue.pop();
+          b.push_back(c);
+          if(c.second+1 < b1.size())
+            queue.push({b0[c.first].value+b1[c.second+1].value, c.first, c.second+1});
+          if(c.second == 0 && c.first+1 < b0.size())
+            queue.push({b0[c.first+1].value+b1[0].value, c.first+1, 0});
         }
       }
+      break;
 
-      if(getGateType(g)!=BooleanGate::NOT && children_processed<getWires(g).size()) {
-        stack.emplace(RecursionParams{g,children_processed+1,partial_value});
-        stack.emplace(RecursionParams{getWires(g)[children_processed],0,0.});
-      } else {
-        double result = partial_value;
-        probability_cache[g]=result;
+    case BooleanGate::OR:
+    {
+      // Merge of the candidates of the children, which are
+      // incompatible since OR gates are deterministic
+      std::priority_queue<KBestCandidate> queue;
+      for(size_t j=0; j<n; ++j)
+        if(!best[children[begin+j]].empty())
+          queue.push({best[children[begin+j]][0].value, j, 0});
+      while(!queue.empty() && b.size()<k) {
+        auto c = queue.top();
+        queue.pop();
+        b.push_back(c);
+        const auto &bj = best[children[begin+c.first]];
+        if(c.second+1 < bj.size())
+          queue.push({bj[c.second+1].value, c.first, c.second+1});
+      }
+      break;
+    }
 
-        if(stack.empty())
-          return result;
-        else
-          stack.emplace(result);
+    case BooleanGate::MULIN:
+    case BooleanGate::MULVAR:
+    case BooleanGate::UNDETERMINED:
+      throw CircuitException("Incorrect gate type");
+    }
+  }
+
+  for(size_t rank=0; rank<best.back().size(); ++rank) {
+    // Traceback of the candidate from the root
+    std::unordered_map<gate_t, bool> assignment;
+    std::stack<std::pair<size_t, size_t> > to_process;
+    to_process.emplace(order.gates.size()-1, rank);
+
+    while(!to_process.empty()) {
+      auto [i, r] = to_process.top();
+      to_process.pop();
+
+      const gate_t g = order.gates[i];
+      const size_t begin = order.first_child[i];
+      const size_t n = order.first_child[i+1]-begin;
+      const auto &c = best[i][r];
+
+      switch(d.getGateType(g)) {
+      case BooleanGate::IN:
+        assignment[g] = true;
+        break;
+      case BooleanGate::NOT:
+        assignment[order.gates[children[begin]]] = false;
+        break;
+      case BooleanGate::AND:
+        if(n >= 1)
+          to_process.emplace(children[begin], c.first);
+        if(n == 2)
+          to_process.emplace(children[begin+1], c.second);
+        break;
+      case BooleanGate::OR:
+        to_process.emplace(children[begin+c.first], c.second);
+        break;
+      default:
+        break;
       }
     }
+
+    Explanation e{1., {}};
+    for(auto var: inputs) {
+      double p = getProb(var);
+      auto it = assignment.find(var);
+      bool value = it == assignment.end() ? p > 1-p : it->second;
+
+      e.probability *= value ? p : 1-p;
+      if(value)
+        e.inputs.push_back(var);
+    }
+    result.push_back(std::move(e));
   }
 
-  // We return from within the while loop, when the stack is empty
-  assert(false);
+  return result;
+}
+
+void dDNNF::sampleWorlds(
+  unsigned long n,
+  std::mt19937_64 &generator,
+  const std::function<void(std::vector<gate_t> &)> &output) const
+{
+  if (gates.size() == 0)
+    throw CircuitException("Cannot sample worlds of an empty circuit");
+
+  const auto &order = evaluationOrder();
+  const size_t *children = order.children.data();
+  const auto probability = gateProbabilities();
+
+  if(!(probability.back() > 0.))
+    throw CircuitException("No world of nonzero probability satisfies the circuit");
+
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  std::vector<gate_t> world;
+  // Value of each input gate in the current world, 0 if unassigned
+  std::unordered_map<gate_t, int> assignment;
+  std::stack<size_t> to_process;
+
+  for(unsigned long s=0; s<n; ++s) {
+    assignment.clear();
+    to_process.push(order.gates.size()-1);
+
+    while(!to_process.empty()) {
+      size_t i = to_process.top();
+      to_process.pop();
+
+      const gate_t g = order.gates[i];
+      const size_t begin = order.first_child[i];
+      const size_t end = order.first_child[i+1];
+
+      switch(getGateType(g)) {
+      case BooleanGate::IN:
+        assignment[g] = 1;
+        break;
+
+      case BooleanGate::NOT:
+      {
+        const gate_t c = order.gates[children[begin]];
+        if(getGateType(c) != BooleanGate::IN)
+          throw CircuitException("NOT gates of the d-DNNF should be over input gates");
+        assignment[c] = -1;
+        break;
+      }
+
+      case BooleanGate::AND:
+        for(size_t j=begin; j<end; ++j)
+          to_process.push(children[j]);
+        break;
+
+      case BooleanGate::OR:
+      {
+        // Children are incompatible, since OR gates are deterministic;
+        // the last child of nonzero probability absorbs rounding errors
+        double u = uniform(generator) * probability[i];
+        size_t chosen = end;
+        for(size_t j=begin; j<end; ++j) {
+          if(probability[children[j]] <= 0.)
+            continue;
+          chosen = j;
+          u -= probability[children[j]];
+          if(u < 0.)
+            break;
+        }
+        to_process.push(children[chosen]);
+        break;
+      }
+
+      case BooleanGate::MULIN:
+      case BooleanGate::MULVAR:
+      case BooleanGate::UNDETERMINED:
+        throw CircuitException("Incorrect gate type");
+      }
+    }
+
+    // Gates satisfied by the traversal do not depend on the other
+    // inputs, whose distribution is thus unchanged
+    world.clear();
+    for(auto var: inputs) {
+      auto it = assignment.find(var);
+      if(it == assignment.end() ? uniform(generator) < getProb(var) : it->second > 0)
+        world.push_back(var);
+    }
+
+    output(world);
+  }
 }
 
 double dDNNF::banzhaf_internal() const {
@@ -287,109 +986,118 @@ double dDNNF::banzhaf_internal() const {
   return result[root];
 }
 
-std::unordered_map<gate_t, std::vector<double> > dDNNF::shapley_delta() const {
-  std::unordered_map<gate_t, std::vector<double> > result;
-
-  if(!isProbabilistic())
-    return result;
-
-  // Stack to simulate recursion: contains a pair (node, b) where b
-  // indicates whether this is the beginning (false) or ending (true) of
-  // the processing of a node
-  std::stack<std::pair<gate_t, bool> > stack;
-  stack.emplace(std::make_pair(root, false));
-
-  while(!stack.empty())
-  {
-    auto [node, b] = stack.top();
-    stack.pop();
-
-    if(result.find(node)!=result.end()) {
-      // Already processed, skip
-      continue;
+// Nodes and weights of the Gauss-Legendre quadrature with m points on
+// [0,1], exact for polynomials of degree up to 2m-1; nodes are the
+// roots of the Legendre polynomial of degree m, found by Newton's method
+static void gauss_legendre(size_t m, std::vector<double> &nodes, std::vector<double> &weights)
+{
+  nodes.resize(m);
+  weights.resize(m);
+
+  for(size_t i=0; i<(m+1)/2; ++i) {
+    double x = std::cos(M_PI*(i+.75)/(m+.5));
+    double derivative;
+
+    for(unsigned iteration=0; iteration<100; ++iteration) {
+      // Legendre polynomials of degree m and m-1 at x, by recurrence
+      double p0 = 1., p1 = 0.;
+      for(size_t j=1; j<=m; ++j) {
+        double p2 = p1;
+        p1 = p0;
+        p0 = ((2.*j-1.)*x*p1-(j-1.)*p2)/j;
+      }
+      derivative = m*(x*p0-p1)/(x*x-1.);
+      double previous = x;
+      x = previous-p0/derivative;
+      if(std::abs(x-previous) <= 1e-15)
+        break;
     }
 
-    switch(getGateType(node)) {
-    case BooleanGate::IN:
-      result[node] = {1-getProb(node), getProb(node)};
-      break;
+    // Symmetric nodes, mapped from [-1,1] to [0,1]
+    double w = 1./((1.-x*x)*derivative*derivative);
+    nodes[i] = (1.-x)/2.;
+    nodes[m-1-i] = (1.+x)/2.;
+    weights[i] = weights[m-1-i] = w;
+  }
+}
 
-    case BooleanGate::NOT:
-    case BooleanGate::OR:
-      if(!b) {
-        if(getWires(node).size()==0) // Has to be an OR False gate
-          result[node] = {1};
-        else {
-          stack.push(std::make_pair(node, true));
-          for(auto c: getWires(node))
-            stack.push(std::make_pair(c, false));
-        }
-      } else {
-        result[node] = result[getWires(node)[0]];
-      }
-      break;
+std::unordered_map<gate_t, double> dDNNF::shapleyAll() const {
+  std::unordered_map<gate_t, double> result;
 
-    case BooleanGate::AND:
-    {
-      if(!b) {
-        if(getWires(node).size()==0) // Has to be an AND True gate
-          result[node] = {1};
-        else {
-          stack.push(std::make_pair(node, true));
-          for(auto c: getWires(node))
-            stack.push(std::make_pair(c, false));
-        }
-      } else {
-        if(getWires(node).size()==1)
-          result[node] = result[getWires(node)[0]];
-        else {
-          assert(getWires(node).size()==2); // AND has been made binary
-          const auto &r1 = result[getWires(node)[0]];
-          const auto &r2 = result[getWires(node)[1]];
-          const auto n1=r1.size()-1;
-          const auto n2=r2.size()-1;
-          for(size_t k=0; k<=n1+n2; ++k) {
-            double r = 0.;
-            for(size_t k1=std::max(0,static_cast<int>(k-n2)); k1<=std::min(k,n1); ++k1) {
-              r+=r1[k1]*r2[k-k1];
-            }
-            result[node].push_back(r);
-          }
-        }
-      }
+  for(auto var: inputs)
+    result[var] = 0.;
 
-      break;
-    }
+  if (gates.size() == 0)
+    return result;
 
-    case BooleanGate::MULIN:
-    case BooleanGate::MULVAR:
-    case BooleanGate::UNDETERMINED:
-      throw CircuitException("Incorrect gate type");
-      break;
-    }
+  const auto &order = evaluationOrder();
+  size_t n = 0;
+  for(auto g: order.gates)
+    if(getGateType(g) == BooleanGate::IN)
+      ++n;
+
+  // The (expected) Shapley value of var is p(var) times the integral
+  // over [0,1] of the derivative of the probability of the root with
+  // respect to that of var, when the probability of every input gate is
+  // multiplied by t: the coefficient 1/((k+1)C(k,l)) of a coalition of
+  // size l among k variables, in the sum defining it, is the integral
+  // of t^l(1-t)^(k-l). The derivative is a polynomial of degree at
+  // most n-1 in t, integrated exactly by a Gauss-Legendre quadrature;
+  // derivatives for all input gates are obtained by one backward pass
+  // per point.
+  std::vector<double> nodes, weights;
+  gauss_legendre(n/2+1, nodes, weights);
+
+  for(size_t j=0; j<nodes.size(); ++j)
+    for(const auto &[var, derivative]: probabilityGradient(nodes[j]))
+      result[var] += weights[j]*derivative;
+
+  for(auto &[var, value]: result) {
+    value *= getProb(var);
+
+    // Avoid rounding errors that make expected Shapley value outside of [-1,1]
+    if(value>1.)
+      value=1.;
+    else if(value<-1.)
+      value=-1.;
   }
 
   return result;
 }
 
-static long long comb(unsigned n, unsigned k)
-{
-  assert(k<=n);
-
-  if(k == 0)
-    return 1;
-  else if(k > n/2)
-    return comb(n,n-k);
-  else return n * comb(n-1,k-1) / k;
+double dDNNF::shapley(gate_t var) const {
+  auto values = shapleyAll();
+  auto it = values.find(var);
+  return it == values.end() ? 0. : it->second;
 }
 
-std::vector<std::vector<double> > dDNNF::shapley_alpha() const {
-  std::unordered_map<gate_t, std::vector<double> > delta {shapley_delta()};
-  std::unordered_map<gate_t, std::vector<std::vector<double> > > result;
+double dDNNF::banzhaf(gate_t var) const {
+  auto cond_pos = condition(var, true);
+  auto cond_neg = condition(var, false);
 
-  // Stack to simulate recursion: contains a pair (node, b) where b
-  // indicates whether this is the beginning (false) or ending (true) of
-  // the processing of a node
+  auto env_pos=cond_pos.banzhaf_internal();
+  auto env_neg=cond_neg.banzhaf_internal();
+
+  return getProb(var) * (env_pos-env_neg);
+}
+
+std::unordered_map<gate_t, double> dDNNF::banzhafAll() const {
+  // banzhaf_internal() evaluates the circuit with weight p for a
+  // positive literal and 1 for a negative one. The result is
+  // multilinear in the weights of the literals of each variable, and
+  // conditioning on var amounts to setting the weights of its literals
+  // to (1,0) or (0,1): env_pos-env_neg is therefore the difference
+  // between the partial derivatives of the result with respect to the
+  // weights of the positive and negative literals of var.
+  //
+  // A NOT gate over a gate g has value S(g)-value(g), where S(g) is the
+  // product of the sums of the weights of both literals of the
+  // variables of g (prod_one_plus_p in banzhaf_internal()). As the
+  // partial derivatives of S(g) with respect to the weights of both
+  // literals of a variable are equal, they cancel out, and only the
+  // adjoint of g needs to be updated.
+  std::vector<gate_t> order;
+  std::unordered_set<gate_t> seen;
   std::stack<std::pair<gate_t, bool> > stack;
   stack.emplace(std::make_pair(root, false));
 
@@ -398,82 +1106,57 @@ std::vector<std::vector<double> > dDNNF::shapley_alpha() const {
     auto [node, b] = stack.top();
     stack.pop();
 
-    if(result.find(node)!=result.end()) {
-      // Already processed, skip
+    if(b) {
+      order.push_back(node);
       continue;
     }
 
+    if(!seen.insert(node).second)
+      continue;
+
+    stack.push(std::make_pair(node, true));
+    for(auto c: getWires(node))
+      stack.push(std::make_pair(c, false));
+  }
+
+  // Upward pass, children before their parents
+  std::unordered_map<gate_t, double> value, prod_one_plus_p;
+  for(auto node: order) {
     switch(getGateType(node)) {
     case BooleanGate::IN:
-      result[node] = {{0},{0,getProb(node)}};
+      value[node] = getProb(node);
+      prod_one_plus_p[node] = 1+getProb(node);
       break;
 
     case BooleanGate::NOT:
-      if(!b) {
-        stack.push(std::make_pair(node, true));
-        stack.push(std::make_pair(getWires(node)[0], false));
-      } else {
-        result[node] = result[getWires(node)[0]];
-        auto k0=isProbabilistic()?0:result[node].size()-1;
-        for(unsigned k=k0; k<result[node].size(); ++k)
-          for(unsigned l=0; l<=k; ++l) {
-            result[node][k][l] *= -1;
-            result[node][k][l] += comb(k,l)*(isProbabilistic()?delta[node][k]:1);
-          }
-      }
+    {
+      auto child = getWires(node)[0];
+      value[node] = prod_one_plus_p[child] - value[child];
+      prod_one_plus_p[node] = prod_one_plus_p[child];
       break;
+    }
 
     case BooleanGate::OR:
-      if(!b) {
-        if(getWires(node).size()==0) // Has to be an OR False gate
-          result[node] = {{0.}};
-        else {
-          stack.push(std::make_pair(node, true));
-          for(auto c: getWires(node))
-            stack.push(std::make_pair(c, false));
-        }
-      } else {
-        result[node] = result[getWires(node)[0]];
-        for(size_t i=1; i<getWires(node).size(); ++i) {
-          const auto &r = result[getWires(node)[i]];
-          auto k0=isProbabilistic()?0:r.size()-1;
-          for(unsigned k=k0; k<r.size(); ++k)
-            for(unsigned l=0; l<r[k].size(); ++l)
-              result[node][k][l]+=r[k][l];
-        }
-      }
+      value[node] =
+        std::accumulate(getWires(node).begin(), getWires(node).end(), 0.,
+                        [&](auto r, auto g) {
+        return r + value[g];
+      });
+      prod_one_plus_p[node] =
+        getWires(node).empty() ? 1. : prod_one_plus_p[getWires(node)[0]];
       break;
 
     case BooleanGate::AND:
-      if(!b) {
-        if(getWires(node).size()==0) // Has to be an AND True gate
-          result[node] = {{1.}};
-        else {
-          stack.push(std::make_pair(node, true));
-          for(auto c: getWires(node))
-            stack.push(std::make_pair(c, false));
-        }
-      } else {
-        if(getWires(node).size()==1)
-          result[node] = result[getWires(node)[0]];
-        else {
-          assert(getWires(node).size()==2); // AND has been made binary
-          const auto &r1 = result[getWires(node)[0]];
-          const auto &r2 = result[getWires(node)[1]];
-          const auto n1=r1.size()-1;
-          const auto n2=r2.size()-1;
-          result[node].resize(n1+n2+1);
-          auto k0=isProbabilistic()?0:n1+n2;
-          for(size_t k=k0; k<=n1+n2; ++k) {
-            result[node][k].resize(k+1);
-            for(size_t l=0; l<=k; ++l) {
-              for(size_t k1=std::max(0,static_cast<int>(k-n2)); k1<=std::min(k,n1); ++k1)
-                for(size_t l1=std::max(0,static_cast<int>(l-k+k1)); l1<=std::min(k1,l); ++l1)
-                  result[node][k][l] += r1[k1][l1] * r2[k-k1][l-l1];
-            }
-          }
-        }
-      }
+      value[node] =
+        std::accumulate(getWires(node).begin(), getWires(node).end(), 1.,
+                        [&](auto r, auto g) {
+        return r * value[g];
+      });
+      prod_one_plus_p[node] =
+        std::accumulate(getWires(node).begin(), getWires(node).end(), 1.,
+                        [&](auto r, auto g) {
+        return r * prod_one_plus_p[g];
+      });
       break;
 
     case BooleanGate::MULIN:
@@ -484,54 +1167,56 @@ std::vector<std::vector<double> > dDNNF::shapley_alpha() const {
     }
   }
 
-  return result[root];
-}
+  // Downward pass, parents before their children
+  std::unordered_map<gate_t, double> adjoint;
+  adjoint[root] = 1.;
 
-double dDNNF::shapley(gate_t var) const {
-  auto cond_pos = condition(var, true);
-  auto cond_neg = condition(var, false);
+  for(auto it = order.rbegin(); it != order.rend(); ++it) {
+    gate_t node = *it;
+    double a = adjoint[node];
+    const auto &w = getWires(node);
 
-  auto alpha_pos=cond_pos.shapley_alpha();
-  auto alpha_neg=cond_neg.shapley_alpha();
+    switch(getGateType(node)) {
+    case BooleanGate::NOT:
+      adjoint[w[0]] -= a;
+      break;
 
-  double result=0.;
+    case BooleanGate::OR:
+      for(auto c: w)
+        adjoint[c] += a;
+      break;
 
-  double k0=isProbabilistic()?0:alpha_pos.size()-1;
-  for(size_t k=k0; k<alpha_pos.size(); ++k)
-    for(size_t l=0; l<=k; ++l) {
-      double pos = alpha_pos[k][l];
-      double neg = alpha_neg[k][l];
-      result += (pos-neg)/comb(k,l)/(k+1);
+    case BooleanGate::AND:
+    {
+      std::vector<double> suffix(w.size()+1, 1.);
+      for(size_t i=w.size(); i>0; --i)
+        suffix[i-1] = suffix[i] * value[w[i-1]];
+      double prefix = 1.;
+      for(size_t i=0; i<w.size(); ++i) {
+        adjoint[w[i]] += a * prefix * suffix[i+1];
+        prefix *= value[w[i]];
+      }
+      break;
     }
 
-  result *= getProb(var);
+    default:
+      break;
+    }
+  }
 
-  // Avoid rounding errors that make expected Shapley value outside of [-1,1]
-  if(result>1.)
-    result=1.;
-  else if(result<-1.)
-    result=-1.;
+  std::unordered_map<gate_t, double> result;
+  for(auto var: inputs)
+    result[var] = getProb(var) * adjoint[var];
 
   return result;
 }
 
-double dDNNF::banzhaf(gate_t var) const {
-  auto cond_pos = condition(var, true);
-  auto cond_neg = condition(var, false);
-
-  auto env_pos=cond_pos.banzhaf_internal();
-  auto env_neg=cond_neg.banzhaf_internal();
-
-  return getProb(var) * (env_pos-env_neg);
-}
-
 dDNNF dDNNF::condition(gate_t var, bool value) const {
   assert(getGateType(var)==BooleanGate::IN);
 
   dDNNF result=*this;
 
   result.setGateType(var, value ? BooleanGate::AND : BooleanGate::OR);
-  result.probability_cache[var] = value?1.:0.;
   result.inputs.erase(var);
   auto it = id2uuid.find(var);
   if(it!=id2uuid.end()) {
@@ -542,6 +1227,28 @@ dDNNF dDNNF::condition(gate_t var, bool value) const {
   return result;
 }
 
+dDNNF dDNNF::conditionAndSimplify(const std::unordered_map<gate_t, bool> &evidence) const {
+  dDNNF result=*this;
+
+  for(const auto &[var, value]: evidence) {
+    assert(getGateType(var)==BooleanGate::IN);
+
+    result.setGateType(var, value ? BooleanGate::AND : BooleanGate::OR);
+    result.inputs.erase(var);
+    auto it = id2uuid.find(var);
+    if(it!=id2uuid.end()) {
+      result.uuid2id.erase(it->second);
+      result.id2uuid.erase(var);
+    }
+  }
+
+  // A single pass removes all constants, whatever the number of
+  // conditioned gates
+  result.simplify();
+
+  return result;
+}
+
 std::vector<gate_t> dDNNF::topological_order(const std::vector<std::vector<gate_t> > &reversedWires) const
 {
   std::vector<gate_t> result;
@@ -580,9 +1287,7 @@ void dDNNF::simplify() {
 
     case BooleanGate::AND:
     case BooleanGate::OR:
-      if(w.size()==0)
-        probability_cache[node]=(getGateType(node)==BooleanGate::AND?1.:0.);
-      else if(w.size()==1) {
+      if(w.size()==1) {
         if(node==getRoot()) {
           root=w[0];
         } else {
@@ -590,13 +1295,12 @@ void dDNNF::simplify() {
             std::replace(wires[static_cast<size_t>(p)].begin(), wires[static_cast<size_t>(p)].end(), node, w[0]);
         }
         w.clear();
-      } else {
+      } else if(w.size()>1) {
         for(auto c=w.begin(); c!=w.end();) {
           if(getGateType(*c)==getGateType(node) && getWires(*c).size()==0)
             c = w.erase(c);
           else if(getGateType(*c)==(getGateType(node)==BooleanGate::AND?BooleanGate::OR:BooleanGate::AND) && getWires(*c).size()==0) {
             setGateType(node, getGateType(*c));
-            probability_cache[node] = getGateType(*c)==BooleanGate::AND?1.:0.;
             w.clear();
             break;
           } else
@@ -608,11 +1312,9 @@ void dDNNF::simplify() {
     case BooleanGate::NOT:
       if(getGateType(w[0])==BooleanGate::AND && getWires(w[0]).size()==0) {
         setGateType(node, BooleanGate::OR);
-        probability_cache[node]=0.;
         w.clear();
       } else if(getGateType(w[0])==BooleanGate::OR && getWires(w[0]).size()==0) {
         setGateType(node, BooleanGate::AND);
-        probability_cache[node]=1.;
         w.clear();
       }
       break;
@@ -644,7 +1346,6 @@ void dDNNF::simplify() {
   {
     if(!used[i]) {
       inputs.erase(gate_t{i});
-      probability_cache.erase(gate_t{i});
       auto it = id2uuid.find(gate_t{i});
       if(it!=id2uuid.end()) {
         uuid2id.erase(it->second);
@@ -660,12 +1361,6 @@ void dDNNF::simplify() {
       wires[newi] = wires[i];
       prob[newi]=prob[i];
 
-      auto it1 = probability_cache.find(gate_t{i});
-      if(it1!=probability_cache.end()) {
-        probability_cache[gate_t{newi}] = it1->second;
-        probability_cache.erase(it1);
-      }
-
       auto it2 = id2uuid.find(gate_t{i});
       if(it2!=id2uuid.end()) {
         id2uuid[gate_t{newi}] = it2->second;
@@ -693,4 +1388,6 @@ void dDNNF::simplify() {
   for(auto &w: wires)
     for(size_t i=0; i<w.size(); ++i)
       w[i]=relabel[static_cast<size_t>(w[i])];
+
+  invalidateEvaluationOrder();
 }
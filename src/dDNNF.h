@@ -1,34 +1,54 @@
 #ifndef DDNNF_H
 #define DDNNF_H
 
+#include <functional>
+#include <random>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "BooleanCircuit.h"
 
 // Forward declaration for friend
 class dDNNFTreeDecompositionBuilder;
 
-struct hash_gate_t
-{
-  size_t operator()(gate_t g) const
-  {
-    return std::hash<typename std::underlying_type<gate_t>::type>()(
-      static_cast<typename std::underlying_type<gate_t>::type>(g));
-  }
-};
-
 class dDNNF : public BooleanCircuit {
 private:
-// To memoize probability evaluation results
-mutable std::unordered_map<gate_t, double, hash_gate_t> probability_cache;
-std::unordered_map<gate_t, std::vector<double> > shapley_delta() const;
-std::vector<std::vector<double> > shapley_alpha() const;
+// Gates reachable from the root, children before their parents (so
+// that the root comes last), with the children of the gate at position
+// i given by their positions children[first_child[i]] to
+// children[first_child[i+1]-1]. Computed once and reused as long as
+// the root does not change and the d-DNNF is not modified: all
+// mutators reset it.
+struct EvaluationOrder {
+  gate_t root{0};
+  size_t nb_gates{0};
+  std::vector<gate_t> gates;
+  std::vector<size_t> first_child;
+  std::vector<size_t> children;
+};
+mutable EvaluationOrder evaluation_order;
+const EvaluationOrder &evaluationOrder() const;
+void invalidateEvaluationOrder() {
+  evaluation_order.gates.clear();
+}
+// Probabilities of all gates of the evaluation order, in this order,
+// when the probability of every input gate is multiplied by scale
+std::vector<double> gateProbabilities(double scale = 1.) const;
 double banzhaf_internal() const;
 std::vector<gate_t> topological_order(const std::vector<std::vector<gate_t> > &reversedWires) const;
 gate_t root{0};
 
+protected:
+void setGateType(gate_t g, BooleanGate t);
+
 public:
+gate_t addGate() override;
+gate_t setGate(BooleanGate t) override;
+gate_t setGate(const uuid &u, BooleanGate t) override;
+using BooleanCircuit::setGate;
+void addWire(gate_t f, gate_t t);
 gate_t getRoot() const {
   return root;
 }
@@ -39,11 +59,74 @@ std::unordered_set<gate_t> vars(gate_t root) const;
 void makeSmooth();
 void makeGatesBinary(BooleanGate type);
 void simplify();
-dDNNF conditionAndSimplify(gate_t var, bool value) const;
+// d-DNNF where each input gate of evidence is fixed to the given
+// value, with the constants this creates propagated away
+dDNNF conditionAndSimplify(const std::unordered_map<gate_t, bool> &evidence) const;
 dDNNF condition(gate_t var, bool value) const;
 double probabilityEvaluation() const;
+// Probabilities of the root for nb_scenarios assignments of
+// probabilities to the input gates, computed in a single sweep; input
+// gates absent from probabilities have the same probability in all
+// scenarios
+std::vector<double> probabilityEvaluation(
+  size_t nb_scenarios,
+  const std::unordered_map<gate_t, std::vector<double> > &probabilities) const;
+// Partial derivatives of the probability of the root with respect to
+// the probability of each input gate, computed in a single backward
+// pass, when the probability of every input gate is multiplied by scale
+std::unordered_map<gate_t, double> probabilityGradient(double scale = 1.) const;
+// Coefficients of the polynomial obtained by giving to each input gate
+// of counted a formal weight x, and to its negation a weight 1: when the
+// values of these input gates are determined by those of the other
+// input gates in all worlds satisfying the root, the coefficient of
+// degree k is the probability that the root holds with exactly k of
+// them true. NOT gates should all be over input gates; throws a
+// CircuitException otherwise.
+std::vector<double> countDistribution(const std::unordered_set<gate_t> &counted) const;
+// A world, given by the input gates that are true in it, along with
+// its probability
+struct Explanation {
+  double probability;
+  std::vector<gate_t> inputs;
+};
+// World of maximal probability among those satisfying the root, in
+// time linear in the d-DNNF, which does not need to be smooth; input
+// gates that do not influence the root take their most probable value.
+// If no world of nonzero probability satisfies the root, the
+// probability of the result is 0. Throws a CircuitException if NOT
+// gates are not all over input gates.
+Explanation mostProbableExplanation() const;
+// The (at most) k worlds of maximal probability among those
+// satisfying the root, by decreasing probability, through k-best
+// dynamic programming over a smooth copy of the d-DNNF with binary AND
+// gates, in time O(|D| k log k); worlds of probability zero are not
+// returned. Input gates that do not influence the root take their most
+// probable value. Throws a CircuitException if NOT gates are not all
+// over input gates.
+std::vector<Explanation> topKExplanations(unsigned k) const;
+// Draws n worlds satisfying the root, independently and according to
+// the distribution of worlds conditioned on the root: probabilities of
+// gates are computed once, after which each world is drawn by a single
+// top-down traversal, choosing a child of each OR gate with probability
+// proportional to its own. Input gates that are not assigned by the
+// traversal are drawn according to their probability. output is called
+// with the input gates true in each world as soon as it is drawn.
+// Throws a CircuitException if the root has probability zero or if NOT
+// gates are not all over input gates.
+void sampleWorlds(
+  unsigned long n,
+  std::mt19937_64 &generator,
+  const std::function<void(std::vector<gate_t> &)> &output) const;
+// (Expected) Shapley value of an input gate; the d-DNNF does not need
+// to be smooth
 double shapley(gate_t var) const;
+// (Expected) Shapley values of all input gates, in time
+// O(|D|·n) for n input gates
+std::unordered_map<gate_t, double> shapleyAll() const;
 double banzhaf(gate_t var) const;
+// Banzhaf values of all input gates, in a single upward and downward
+// pass over a smooth d-DNNF
+std::unordered_map<gate_t, double> banzhafAll() const;
 
 friend dDNNFTreeDecompositionBuilder;
 friend dDNNF BooleanCircuit::compilation(gate_t g, std::string compiler) const;
@@ -0,0 +1,265 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/uuid.h"
+#include "executor/spi.h"
+#include "provsql_shmem.h"
+#include "provsql_utils.h"
+
+PG_FUNCTION_INFO_V1(most_probable_explanation);
+PG_FUNCTION_INFO_V1(top_k_explanations);
+PG_FUNCTION_INFO_V1(sample_worlds);
+}
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "BooleanCircuit.h"
+#include "provsql_utils_cpp.h"
+#include "dDNNFTreeDecompositionBuilder.h"
+#include "CircuitFromShMem.h"
+
+using namespace std;
+
+// Array of the tokens of the input gates of c in world
+static ArrayType *world_tokens(const BooleanCircuit &c, const unordered_set<gate_t> &world)
+{
+  constants_t constants = initialize_constants(true);
+  vector<pg_uuid_t> uuids;
+  vector<Datum> result;
+
+  for(auto g: c.getInputs())
+    if(world.find(g) != world.end())
+      uuids.push_back(string2uuid(c.getUUID(g)));
+
+  // Elements are copied into the array
+  for(const auto &u: uuids)
+    result.push_back(UUIDPGetDatum(&u));
+
+  return construct_array(result.data(), result.size(), constants.OID_TYPE_UUID, UUID_LEN, false, 'c');
+}
+
+// Input gates of c true in an explanation computed on dd, a d-DNNF
+// compiled from c, completed by the most probable value of the inputs
+// of c absent from dd, which do not influence its root; the
+// probability of the explanation is updated accordingly, and divided
+// by the factor of rewriteMultivaluedGatesExclusive
+static unordered_set<gate_t> explanation_world(
+  BooleanCircuit &c, const dDNNF &dd, double factor, dDNNF::Explanation &e)
+{
+  unordered_set<gate_t> result;
+
+  e.probability /= factor;
+
+  for(auto g: e.inputs)
+    result.insert(c.getGate(dd.getUUID(g)));
+
+  for(auto g: c.getInputs()) {
+    if(dd.hasGate(c.getUUID(g)))
+      continue;
+
+    double p = c.getProb(g);
+    e.probability *= std::max(p, 1-p);
+    if(p > 1-p)
+      result.insert(g);
+  }
+
+  return result;
+}
+
+Datum most_probable_explanation(PG_FUNCTION_ARGS)
+{
+  try {
+    if(PG_ARGISNULL(0))
+      PG_RETURN_NULL();
+
+    pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
+
+    std::string method;
+    if(!PG_ARGISNULL(1)) {
+      text *t = PG_GETARG_TEXT_P(1);
+      method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+    }
+
+    std::string args;
+    if(!PG_ARGISNULL(2)) {
+      text *t = PG_GETARG_TEXT_P(2);
+      args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+    }
+
+    BooleanCircuit c = createBooleanCircuit(token);
+    double factor;
+    auto gate = c.rewriteMultivaluedGatesExclusive(c.getGate(uuid2string(token)), factor);
+    dDNNF dd = c.makeDD(gate, method, args, true);
+    auto e = dd.mostProbableExplanation();
+
+    if(e.probability <= 0.)
+      PG_RETURN_NULL();
+
+    auto world = explanation_world(c, dd, factor, e);
+
+    TupleDesc tupdesc;
+    Datum values[2];
+    bool nulls[2] = {false, false};
+
+    get_call_result_type(fcinfo,NULL,&tupdesc);
+    tupdesc = BlessTupleDesc(tupdesc);
+
+    values[0] = PointerGetDatum(world_tokens(c, world));
+    values[1] = Float8GetDatum(e.probability);
+
+    PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+  } catch(const std::exception &e) {
+    elog(ERROR, "most_probable_explanation: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "most_probable_explanation: Unknown exception");
+  }
+
+  PG_RETURN_NULL();
+}
+
+Datum top_k_explanations(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+  MemoryContext per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+  MemoryContext oldcontext    = MemoryContextSwitchTo(per_query_ctx);
+
+  TupleDesc tupdesc = rsinfo->expectedDesc;
+  Tuplestorestate *tupstore     = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+
+  try {
+    if(!PG_ARGISNULL(0) && !PG_ARGISNULL(1)) {
+      pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
+      int k = PG_GETARG_INT32(1);
+
+      if(k < 0)
+        elog(ERROR, "Invalid number of explanations: %d", k);
+
+      std::string method;
+      if(!PG_ARGISNULL(2)) {
+        text *t = PG_GETARG_TEXT_P(2);
+        method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      std::string args;
+      if(!PG_ARGISNULL(3)) {
+        text *t = PG_GETARG_TEXT_P(3);
+        args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      BooleanCircuit c = createBooleanCircuit(token);
+      double factor;
+      auto gate = c.rewriteMultivaluedGatesExclusive(c.getGate(uuid2string(token)), factor);
+      dDNNF dd = c.makeDD(gate, method, args, true);
+
+      // Explanations are returned by decreasing probability
+      for(auto &e: dd.topKExplanations(k)) {
+        auto world = explanation_world(c, dd, factor, e);
+
+        Datum values[2] = {
+          PointerGetDatum(world_tokens(c, world)), Float8GetDatum(e.probability)
+        };
+        bool nulls[sizeof(values)] = {0, 0};
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+      }
+    }
+  } catch(const std::exception &e) {
+    elog(ERROR, "top_k_explanations: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "top_k_explanations: Unknown exception");
+  }
+
+  tuplestore_donestoring(tupstore);
+  MemoryContextSwitchTo(oldcontext);
+
+  PG_RETURN_NULL();
+}
+
+Datum sample_worlds(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+  MemoryContext per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+  MemoryContext oldcontext    = MemoryContextSwitchTo(per_query_ctx);
+
+  TupleDesc tupdesc = rsinfo->expectedDesc;
+  Tuplestorestate *tupstore     = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+
+  try {
+    if(!PG_ARGISNULL(0) && !PG_ARGISNULL(1)) {
+      pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
+      int n = PG_GETARG_INT32(1);
+
+      if(n < 0)
+        elog(ERROR, "Invalid number of samples: %d", n);
+
+      // Samples are reproducible when a seed is given
+      std::mt19937_64 generator(PG_ARGISNULL(2) ? std::random_device()() : PG_GETARG_INT64(2));
+
+      std::string method;
+      if(!PG_ARGISNULL(3)) {
+        text *t = PG_GETARG_TEXT_P(3);
+        method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      std::string args;
+      if(!PG_ARGISNULL(4)) {
+        text *t = PG_GETARG_TEXT_P(4);
+        args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      BooleanCircuit c = createBooleanCircuit(token);
+      double factor;
+      auto gate = c.rewriteMultivaluedGatesExclusive(c.getGate(uuid2string(token)), factor);
+      dDNNF dd = c.makeDD(gate, method, args, true);
+
+      // Inputs of c absent from dd do not influence token, and are drawn
+      // according to their probability
+      vector<gate_t> others;
+      for(auto g: c.getInputs())
+        if(!dd.hasGate(c.getUUID(g)))
+          others.push_back(g);
+      std::uniform_real_distribution<double> uniform(0., 1.);
+
+      dd.sampleWorlds(n, generator, [&](vector<gate_t> &sample) {
+        unordered_set<gate_t> world;
+        for(auto g: sample)
+          world.insert(c.getGate(dd.getUUID(g)));
+        for(auto g: others)
+          if(uniform(generator) < c.getProb(g))
+            world.insert(g);
+
+        // Worlds are output as soon as they are drawn
+        Datum values[1] = {PointerGetDatum(world_tokens(c, world))};
+        bool nulls[sizeof(values)] = {0};
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+        pfree(DatumGetPointer(values[0]));
+      });
+    }
+  } catch(const std::exception &e) {
+    elog(ERROR, "sample_worlds: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "sample_worlds: Unknown exception");
+  }
+
+  tuplestore_donestoring(tupstore);
+  MemoryContextSwitchTo(oldcontext);
+
+  PG_RETURN_NULL();
+}
@@ -0,0 +1,234 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "parser/parse_coerce.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/uuid.h"
+
+#include "math.h"
+
+#include "provsql_shmem.h"
+
+/* Number of rows fetched from the cursor, and of probabilities stored
+ * in the in-memory circuit under a single lock acquisition */
+#define PROB_COLUMN_BATCH_SIZE 1000
+
+/* Set the probabilities of input gates from the result of a query
+ * returning tokens and probabilities (as double precision values);
+ * must be called between SPI_connect() and SPI_finish(). The token
+ * column should not be named provsql, for the query not to be
+ * rewritten into a query returning no token column. */
+static void load_probabilities(const char *query)
+{
+  Portal portal;
+  pg_uuid_t tokens[PROB_COLUMN_BATCH_SIZE];
+  double probs[PROB_COLUMN_BATCH_SIZE];
+
+  portal = SPI_cursor_open_with_args(NULL, query, 0, NULL, NULL, NULL, true, 0);
+
+  for(;;) {
+    unsigned nb = 0;
+
+    SPI_cursor_fetch(portal, true, PROB_COLUMN_BATCH_SIZE);
+    if(SPI_processed == 0)
+      break;
+
+    for(uint64 i = 0; i < SPI_processed; ++i) {
+      HeapTuple tuple = SPI_tuptable->vals[i];
+      TupleDesc tupdesc = SPI_tuptable->tupdesc;
+      bool isnull;
+      Datum token = SPI_getbinval(tuple, tupdesc, 1, &isnull);
+      Datum prob;
+
+      if(isnull)
+        continue;
+
+      prob = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+
+      tokens[nb] = *DatumGetUUIDP(token);
+      // NULL probabilities leave the probability of the gate unchanged
+      probs[nb] = isnull ? NAN : DatumGetFloat8(prob);
+      ++nb;
+    }
+
+    SPI_freetuptable(SPI_tuptable);
+
+    provsql_set_probs(tokens, probs, nb);
+  }
+
+  SPI_cursor_close(portal);
+}
+
+PG_FUNCTION_INFO_V1(load_prob_column);
+
+/* Set the probability of the input gate of every tuple of a table to the
+ * value of one of its columns, in a single scan of the table */
+Datum load_prob_column(PG_FUNCTION_ARGS)
+{
+  Oid relid;
+  char *prob_column;
+  StringInfoData query;
+
+  if(PG_ARGISNULL(0) || PG_ARGISNULL(1))
+    elog(ERROR, "Invalid NULL value passed to load_prob_column");
+
+  relid = PG_GETARG_OID(0);
+  prob_column = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+  initStringInfo(&query);
+  appendStringInfo(&query,
+                   "SELECT provsql AS token, %s::double precision FROM %s",
+                   quote_identifier(prob_column),
+                   DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(relid))));
+
+  SPI_connect();
+  load_probabilities(query.data);
+  SPI_finish();
+
+  PG_RETURN_VOID();
+}
+
+/* Conversion to double precision of the values of the probability
+ * column, as done by a cast, looked up once per statement and kept in
+ * fn_extra */
+typedef struct ProbColumnCast
+{
+  Oid type;
+  CoercionPathType path;
+  FmgrInfo function; // cast function, or output function of type
+} ProbColumnCast;
+
+static double convert_probability(FunctionCallInfo fcinfo, const char *prob_column, Oid type, Datum value)
+{
+  ProbColumnCast *cast = (ProbColumnCast *) fcinfo->flinfo->fn_extra;
+
+  if(cast == NULL || cast->type != type) {
+    Oid funcid = InvalidOid;
+
+    if(cast == NULL) {
+      cast = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, sizeof(ProbColumnCast));
+      fcinfo->flinfo->fn_extra = cast;
+    }
+
+    cast->type = InvalidOid;
+    cast->path = find_coercion_pathway(FLOAT8OID, type, COERCION_EXPLICIT, &funcid);
+
+    if(cast->path == COERCION_PATH_FUNC) {
+      fmgr_info_cxt(funcid, &cast->function, fcinfo->flinfo->fn_mcxt);
+    } else if(cast->path == COERCION_PATH_COERCEVIAIO) {
+      bool typisvarlena;
+      getTypeOutputInfo(type, &funcid, &typisvarlena);
+      fmgr_info_cxt(funcid, &cast->function, fcinfo->flinfo->fn_mcxt);
+    } else if(cast->path != COERCION_PATH_RELABELTYPE) {
+      elog(ERROR, "set_prob_trigger: cannot convert column %s to double precision", prob_column);
+    }
+
+    cast->type = type;
+  }
+
+  switch(cast->path) {
+  case COERCION_PATH_FUNC:
+    return DatumGetFloat8(FunctionCall1(&cast->function, value));
+  case COERCION_PATH_COERCEVIAIO:
+    return DatumGetFloat8(DirectFunctionCall1(float8in,
+                                              CStringGetDatum(OutputFunctionCall(&cast->function, value))));
+  default:
+    return DatumGetFloat8(value);
+  }
+}
+
+PG_FUNCTION_INFO_V1(set_prob_trigger);
+
+/* Trigger keeping the probabilities of the input gates of a table in
+ * sync with the column given as argument. When used as an AFTER INSERT
+ * or AFTER UPDATE ... FOR EACH STATEMENT trigger with transition tables
+ * named new_table (and old_table for updates) (PostgreSQL >= 10), all
+ * probabilities set by the statement are set in batches; otherwise, it
+ * is used as an AFTER ... FOR EACH ROW trigger. */
+Datum set_prob_trigger(PG_FUNCTION_ARGS)
+{
+  TriggerData *trigdata = (TriggerData *) fcinfo->context;
+  TupleDesc tupdesc;
+  char *prob_column;
+  int attnum, prob_attnum;
+
+  if(!CALLED_AS_TRIGGER(fcinfo))
+    elog(ERROR, "set_prob_trigger: not called by trigger manager");
+
+  if(trigdata->tg_trigger->tgnargs != 1)
+    elog(ERROR, "set_prob_trigger: the probability column should be given as argument");
+  prob_column = trigdata->tg_trigger->tgargs[0];
+
+  tupdesc = trigdata->tg_relation->rd_att;
+  attnum = SPI_fnumber(tupdesc, "provsql");
+  if(attnum <= 0)
+    elog(ERROR, "set_prob_trigger: no provenance column in table %s",
+         RelationGetRelationName(trigdata->tg_relation));
+  prob_attnum = SPI_fnumber(tupdesc, prob_column);
+  if(prob_attnum <= 0)
+    elog(ERROR, "set_prob_trigger: no column %s in table %s",
+         prob_column, RelationGetRelationName(trigdata->tg_relation));
+
+  if(TRIGGER_FIRED_FOR_ROW(trigdata->tg_event)) {
+    HeapTuple tuple = TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) ?
+                      trigdata->tg_newtuple : trigdata->tg_trigtuple;
+    bool isnull;
+    Datum token = heap_getattr(tuple, attnum, tupdesc, &isnull);
+    Datum value;
+    double prob;
+
+    if(isnull)
+      return PointerGetDatum(NULL);
+
+    value = heap_getattr(tuple, prob_attnum, tupdesc, &isnull);
+    if(isnull)
+      return PointerGetDatum(NULL);
+
+    // Same conversion as the cast in load_probabilities
+    prob = convert_probability(fcinfo, prob_column, SPI_gettypeid(tupdesc, prob_attnum), value);
+
+    provsql_set_probs(DatumGetUUIDP(token), &prob, 1);
+
+    return PointerGetDatum(NULL);
+  } else {
+#if PG_VERSION_NUM >= 100000
+    StringInfoData query;
+
+    if(trigdata->tg_newtable == NULL)
+      elog(ERROR, "set_prob_trigger: statement-level trigger requires a NEW TABLE transition relation");
+
+    initStringInfo(&query);
+    if(TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event)) {
+      // Only rows whose probability column was changed
+      if(trigdata->tg_oldtable == NULL)
+        elog(ERROR, "set_prob_trigger: statement-level update trigger requires an OLD TABLE transition relation");
+
+      appendStringInfo(&query,
+                       "SELECT n.provsql AS token, n.%s::double precision "
+                       "FROM new_table n JOIN old_table o ON n.provsql=o.provsql "
+                       "WHERE n.%s IS DISTINCT FROM o.%s",
+                       quote_identifier(prob_column),
+                       quote_identifier(prob_column),
+                       quote_identifier(prob_column));
+    } else {
+      appendStringInfo(&query,
+                       "SELECT provsql AS token, %s::double precision FROM new_table",
+                       quote_identifier(prob_column));
+    }
+
+    SPI_connect();
+    SPI_register_trigger_data(trigdata);
+    load_probabilities(query.data);
+    SPI_finish();
+
+    return PointerGetDatum(NULL);
+#else
+    elog(ERROR, "set_prob_trigger: statement-level triggers require PostgreSQL 10 or later");
+#endif
+  }
+}
@@ -2,17 +2,25 @@ extern "C" {
 #include "postgres.h"
 #include "fmgr.h"
 #include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/uuid.h"
 #include "executor/spi.h"
 #include "provsql_shmem.h"
 #include "provsql_utils.h"
 
 PG_FUNCTION_INFO_V1(probability_evaluate);
+PG_FUNCTION_INFO_V1(probability_evaluate_evidence);
+PG_FUNCTION_INFO_V1(probability_gradient);
+PG_FUNCTION_INFO_V1(probability_evaluate_scenarios);
 }
 
 #include <set>
 #include <cmath>
 #include <csignal>
+#include <unordered_map>
+#include <vector>
 
 #include "BooleanCircuit.h"
 #include "provsql_utils_cpp.h"
@@ -26,14 +34,58 @@ static void provsql_sigint_handler (int)
   provsql_interrupted = true;
 }
 
+// Input gates of c fixed by the evidence, which must only contain input
+// tokens; evidence is a list of tokens along with the value they are
+// fixed to
+static unordered_map<gate_t, bool> read_evidence(
+  BooleanCircuit &c, const vector<pair<pg_uuid_t, bool> > &evidence)
+{
+  unordered_map<gate_t, bool> result;
+
+  for(const auto &[token, value]: evidence) {
+    auto g = c.getGate(uuid2string(token));
+    if(c.getGateType(g) != BooleanGate::IN)
+      throw CircuitException("Evidence can only be given on input tokens");
+
+    auto [it, inserted] = result.emplace(g, value);
+    if(!inserted && it->second != value)
+      throw CircuitException("Evidence has probability zero");
+  }
+
+  return result;
+}
+
 static Datum probability_evaluate_internal
-  (pg_uuid_t token, const string &method, const string &args)
+  (pg_uuid_t token, const string &method, const string &args, const char *scenario,
+  const vector<pair<pg_uuid_t, bool> > &evidence = {})
 {
-  BooleanCircuit c = createBooleanCircuit(token);
+  vector<pg_uuid_t> tokens{token};
+  for(const auto &e: evidence)
+    tokens.push_back(e.first);
+  BooleanCircuit c = createBooleanCircuit(tokens, scenario);
 
   double result;
   auto gate = c.getGate(uuid2string(token));
 
+  // Input gates are independent, so that P(token | evidence) is the
+  // probability of token once the inputs of the evidence are fixed:
+  // P(token AND evidence) and P(evidence) share a single circuit, and
+  // the latter is the product of the probabilities of the literals
+  unordered_map<gate_t, bool> fixed;
+  try {
+    fixed = read_evidence(c, evidence);
+  } catch(CircuitException &e) {
+    elog(ERROR, "%s", e.what());
+  }
+
+  double evidence_probability = 1.;
+  for(const auto &[g, value]: fixed) {
+    evidence_probability *= value ? c.getProb(g) : 1-c.getProb(g);
+    c.setProb(g, value ? 1. : 0.);
+  }
+  if(evidence_probability <= 0.)
+    elog(ERROR, "Evidence has probability zero");
+
   // Display the circuit for debugging:
   // elog(WARNING, "%s", c.toString(gate).c_str());
 
@@ -83,6 +135,17 @@ static Datum probability_evaluate_internal
         result = c.WeightMC(gate, args);
       } else if(method=="compilation" || method=="tree-decomposition" || method=="") {
         auto dd = c.makeDD(gate, method, args);
+
+        if(!fixed.empty()) {
+          // Conditioning removes the evidence, and all the gates it
+          // makes constant, from the d-DNNF before its evaluation
+          unordered_map<gate_t, bool> dd_fixed;
+          for(const auto &[g, value]: fixed)
+            if(dd.hasGate(c.getUUID(g)))
+              dd_fixed[dd.getGate(c.getUUID(g))] = value;
+          dd = dd.conditionAndSimplify(dd_fixed);
+        }
+
         result = dd.probabilityEvaluation();
       } else {
         elog(ERROR, "Wrong method '%s' for probability evaluation", method.c_str());
@@ -110,6 +173,7 @@ Datum probability_evaluate(PG_FUNCTION_ARGS)
     Datum token = PG_GETARG_DATUM(0);
     string method;
     string args;
+    const char *scenario = nullptr;
 
     if(PG_ARGISNULL(0))
       PG_RETURN_NULL();
@@ -124,7 +188,11 @@ Datum probability_evaluate(PG_FUNCTION_ARGS)
       args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
     }
 
-    return probability_evaluate_internal(*DatumGetUUIDP(token), method, args);
+    // Named probability scenario, the active one by default
+    if(!PG_ARGISNULL(3))
+      scenario = text_to_cstring(PG_GETARG_TEXT_PP(3));
+
+    return probability_evaluate_internal(*DatumGetUUIDP(token), method, args, scenario);
   } catch(const std::exception &e) {
     elog(ERROR, "probability_evaluate: %s", e.what());
   } catch(...) {
@@ -133,3 +201,282 @@ Datum probability_evaluate(PG_FUNCTION_ARGS)
 
   PG_RETURN_NULL();
 }
+
+// Evidence of a uuid[] argument, with all tokens fixed to value
+static void add_evidence(
+  ArrayType *array, bool value, vector<pair<pg_uuid_t, bool> > &evidence)
+{
+  Datum *elems;
+  bool *nulls;
+  int nb;
+
+  deconstruct_array(array, ARR_ELEMTYPE(array), UUID_LEN, false, 'c', &elems, &nulls, &nb);
+
+  for(int i=0; i<nb; ++i)
+    if(!nulls[i])
+      evidence.emplace_back(*DatumGetUUIDP(elems[i]), value);
+}
+
+Datum probability_evaluate_evidence(PG_FUNCTION_ARGS)
+{
+  try {
+    Datum token = PG_GETARG_DATUM(0);
+    vector<pair<pg_uuid_t, bool> > evidence;
+    string method;
+    string args;
+    const char *scenario = nullptr;
+
+    if(PG_ARGISNULL(0))
+      PG_RETURN_NULL();
+
+    if(!PG_ARGISNULL(1))
+      add_evidence(PG_GETARG_ARRAYTYPE_P(1), true, evidence);
+
+    // Negated evidence: tokens known to be false
+    if(!PG_ARGISNULL(2))
+      add_evidence(PG_GETARG_ARRAYTYPE_P(2), false, evidence);
+
+    if(!PG_ARGISNULL(3)) {
+      text *t = PG_GETARG_TEXT_P(3);
+      method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+    }
+
+    if(!PG_ARGISNULL(4)) {
+      text *t = PG_GETARG_TEXT_P(4);
+      args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+    }
+
+    if(!PG_ARGISNULL(5))
+      scenario = text_to_cstring(PG_GETARG_TEXT_PP(5));
+
+    return probability_evaluate_internal(*DatumGetUUIDP(token), method, args, scenario, evidence);
+  } catch(const std::exception &e) {
+    elog(ERROR, "probability_evaluate: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "probability_evaluate: Unknown exception");
+  }
+
+  PG_RETURN_NULL();
+}
+
+Datum probability_gradient(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+  MemoryContext per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+  MemoryContext oldcontext    = MemoryContextSwitchTo(per_query_ctx);
+
+  TupleDesc tupdesc = rsinfo->expectedDesc;
+  Tuplestorestate *tupstore     = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+
+  try {
+    if(!PG_ARGISNULL(0)) {
+      pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
+
+      std::string method;
+      if(!PG_ARGISNULL(1)) {
+        text *t = PG_GETARG_TEXT_P(1);
+        method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      std::string args;
+      if(!PG_ARGISNULL(2)) {
+        text *t = PG_GETARG_TEXT_P(2);
+        args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      BooleanCircuit c = createBooleanCircuit(token);
+      auto gate = c.getGate(uuid2string(token));
+      // Inputs added when rewriting multivalued gates have no token
+      auto inputs = c.getInputs();
+
+      c.rewriteMultivaluedGates();
+      dDNNF dd = c.makeDD(gate, method, args);
+      auto gradient = dd.probabilityGradient();
+
+      for(auto &v_circuit_gate: inputs) {
+        auto var_uuid_string = c.getUUID(v_circuit_gate);
+        pg_uuid_t *uuidp = reinterpret_cast<pg_uuid_t*>(palloc(UUID_LEN));
+        *uuidp = string2uuid(var_uuid_string);
+
+        // Inputs absent from the d-DNNF do not influence the probability
+        double result = 0.;
+        if(dd.hasGate(var_uuid_string)) {
+          auto it = gradient.find(dd.getGate(var_uuid_string));
+          if(it != gradient.end())
+            result = it->second;
+        }
+
+        Datum values[2] = {
+          UUIDPGetDatum(uuidp), Float8GetDatum(result)
+        };
+        bool nulls[sizeof(values)] = {0, 0};
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+      }
+    }
+  } catch(const std::exception &e) {
+    elog(ERROR, "probability_gradient: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "probability_gradient: Unknown exception");
+  }
+
+  tuplestore_donestoring(tupstore);
+  MemoryContextSwitchTo(oldcontext);
+
+  PG_RETURN_NULL();
+}
+
+// Reads the scenarios of a table with columns scenario, provenance, and
+// probability: names of the scenarios, in the order of the scenario
+// column, and probabilities of the input gates of c in each of them, or
+// NaN when an input keeps its own probability. Must be called before
+// multivalued inputs of c are rewritten, as the probabilities of their
+// alternatives are then folded into fresh inputs; scenarios assigning
+// them a probability are rejected.
+static void read_scenarios(
+  Oid relid,
+  BooleanCircuit &c,
+  vector<string> &names,
+  unordered_map<string, vector<double> > &assigned)
+{
+  string query = string("SELECT scenario::text, provenance, probability::double precision FROM ") +
+                 DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(relid))) +
+                 " ORDER BY scenario";
+  bool multivalued = false;
+
+  SPI_connect();
+
+  if(SPI_execute(query.c_str(), true, 0) != SPI_OK_SELECT) {
+    SPI_finish();
+    elog(ERROR, "Cannot read scenarios from %s", get_rel_name(relid));
+  }
+
+  for(uint64 i = 0; i < SPI_processed; ++i) {
+    HeapTuple tuple = SPI_tuptable->vals[i];
+    TupleDesc tupdesc = SPI_tuptable->tupdesc;
+    bool isnull;
+
+    char *name = SPI_getvalue(tuple, tupdesc, 1);
+    if(!name)
+      continue;
+    if(names.empty() || names.back() != name)
+      names.push_back(name);
+
+    Datum token = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+    if(isnull)
+      continue;
+    string uuid = uuid2string(*DatumGetUUIDP(token));
+    if(!c.hasGate(uuid))
+      continue;
+
+    Datum probability = SPI_getbinval(tuple, tupdesc, 3, &isnull);
+    if(isnull)
+      continue;
+
+    if(c.getGateType(c.getGate(uuid)) == BooleanGate::MULIN) {
+      multivalued = true;
+      break;
+    }
+
+    auto &v = assigned[uuid];
+    v.resize(names.size(), NAN);
+    v[names.size()-1] = DatumGetFloat8(probability);
+  }
+
+  SPI_finish();
+
+  if(multivalued)
+    throw CircuitException("Scenarios cannot assign probabilities to multivalued inputs");
+
+  for(auto &[uuid, v]: assigned)
+    v.resize(names.size(), NAN);
+}
+
+Datum probability_evaluate_scenarios(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+
+  MemoryContext per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+  MemoryContext oldcontext    = MemoryContextSwitchTo(per_query_ctx);
+
+  TupleDesc tupdesc = rsinfo->expectedDesc;
+  Tuplestorestate *tupstore     = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+
+  try {
+    if(!PG_ARGISNULL(0) && !PG_ARGISNULL(1)) {
+      pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
+      Oid scenarios = PG_GETARG_OID(1);
+
+      std::string method;
+      if(!PG_ARGISNULL(2)) {
+        text *t = PG_GETARG_TEXT_P(2);
+        method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      std::string args;
+      if(!PG_ARGISNULL(3)) {
+        text *t = PG_GETARG_TEXT_P(3);
+        args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      BooleanCircuit c = createBooleanCircuit(token);
+      auto gate = c.getGate(uuid2string(token));
+
+      vector<string> names;
+      unordered_map<string, vector<double> > assigned;
+      read_scenarios(scenarios, c, names, assigned);
+
+      // The circuit is compiled once, and the d-DNNF evaluated for all
+      // scenarios at the same time
+      c.rewriteMultivaluedGates();
+      dDNNF dd = c.makeDD(gate, method, args);
+
+      // Inputs absent from the d-DNNF do not influence the probability
+      unordered_map<gate_t, vector<double> > probabilities;
+      for(auto &[uuid, v]: assigned) {
+        if(!dd.hasGate(uuid))
+          continue;
+        auto g = dd.getGate(uuid);
+        for(auto &p: v)
+          if(std::isnan(p))
+            p = dd.getProb(g);
+        probabilities[g] = std::move(v);
+      }
+
+      auto results = dd.probabilityEvaluation(names.size(), probabilities);
+
+      for(size_t i=0; i<names.size(); ++i) {
+        double result = results[i];
+
+        // Avoid rounding errors that make probability outside of [0,1]
+        if(result>1.)
+          result=1.;
+        else if(result<0.)
+          result=0.;
+
+        Datum values[2] = {
+          CStringGetTextDatum(names[i].c_str()), Float8GetDatum(result)
+        };
+        bool nulls[sizeof(values)] = {0, 0};
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+      }
+    }
+  } catch(const std::exception &e) {
+    elog(ERROR, "probability_evaluate_scenarios: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "probability_evaluate_scenarios: Unknown exception");
+  }
+
+  tuplestore_donestoring(tupstore);
+  MemoryContextSwitchTo(oldcontext);
+
+  PG_RETURN_NULL();
+}
@@ -0,0 +1,198 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/timestamp.h"
+#include "utils/uuid.h"
+#include "executor/spi.h"
+
+#include "provsql_shmem.h"
+#include "provsql_utils.h"
+
+PG_FUNCTION_INFO_V1(provenance_evaluate);
+}
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "GenericCircuit.hpp"
+#include "CircuitFromShMem.h"
+#include "ProvenanceMapping.h"
+#include "UserSemiring.h"
+#include "provsql_utils_cpp.h"
+
+using namespace std;
+
+// Values of the gates already evaluated by a given call site of
+// provenance_evaluate within the current statement, for a given
+// semiring and provenance mapping; stored in fn_extra, so that
+// subcircuits shared by several rows of a query are only evaluated
+// once
+struct EvaluationCache {
+  TimestampTz statement;
+  Oid token2value;
+  Oid element_type;
+  int16 typlen;
+  bool typbyval;
+  DatumValue element_one;
+  Oid plus_function;
+  Oid times_function;
+  Oid monus_function;
+  Oid delta_function;
+  MemoryContext context;
+  unique_ptr<ProvenanceMapping> mapping;
+  unordered_map<string, DatumValue> values;
+  MemoryContextCallback callback;
+
+  bool matches(Oid token2value, Oid element_type, Datum element_one,
+               Oid plus_function, Oid times_function, Oid monus_function, Oid delta_function) const {
+    return statement == GetCurrentStatementStartTimestamp() &&
+           this->token2value == token2value && this->element_type == element_type &&
+           this->plus_function == plus_function && this->times_function == times_function &&
+           this->monus_function == monus_function && this->delta_function == delta_function &&
+           datumIsEqual(this->element_one.value, element_one, typbyval, typlen);
+  }
+};
+
+static void free_evaluation_cache(void *arg)
+{
+  delete reinterpret_cast<EvaluationCache *>(arg);
+}
+
+static EvaluationCache *get_evaluation_cache(
+  FunctionCallInfo fcinfo,
+  Oid token2value,
+  Oid element_type,
+  Datum element_one,
+  Oid plus_function,
+  Oid times_function,
+  Oid monus_function,
+  Oid delta_function)
+{
+  EvaluationCache *cache = reinterpret_cast<EvaluationCache *>(fcinfo->flinfo->fn_extra);
+
+  if(cache && cache->element_type == element_type &&
+     cache->matches(token2value, element_type, element_one, plus_function, times_function, monus_function, delta_function))
+    return cache;
+
+  if(!cache) {
+    cache = new EvaluationCache();
+    cache->context = fcinfo->flinfo->fn_mcxt;
+    cache->callback.func = free_evaluation_cache;
+    cache->callback.arg = cache;
+    MemoryContextRegisterResetCallback(cache->context, &cache->callback);
+    fcinfo->flinfo->fn_extra = cache;
+  }
+
+  // Values of the previous cache are not freed, they live in the
+  // function's memory context until the end of the query
+  cache->values.clear();
+  cache->mapping.reset(new ProvenanceMapping(token2value, cache->context));
+  cache->statement = GetCurrentStatementStartTimestamp();
+  cache->token2value = token2value;
+  cache->element_type = element_type;
+  get_typlenbyval(element_type, &cache->typlen, &cache->typbyval);
+  cache->element_one.value = datumCopy(element_one, cache->typbyval, cache->typlen);
+  cache->element_one.isnull = false;
+  cache->plus_function = plus_function;
+  cache->times_function = times_function;
+  cache->monus_function = monus_function;
+  cache->delta_function = delta_function;
+
+  return cache;
+}
+
+static Datum provenance_evaluate_internal(
+  FunctionCallInfo fcinfo,
+  pg_uuid_t token,
+  Oid token2value,
+  Oid element_type,
+  Datum element_one,
+  Oid plus_function,
+  Oid times_function,
+  Oid monus_function,
+  Oid delta_function)
+{
+  EvaluationCache *cache = get_evaluation_cache(
+    fcinfo, token2value, element_type, element_one,
+    plus_function, times_function, monus_function, delta_function);
+  string root = uuid2string(token);
+  DatumValue result;
+
+  auto it = cache->values.find(root);
+  if(it != cache->values.end())
+    result = it->second;
+  else {
+    GenericCircuit c = createGenericCircuit(
+      token,
+      [cache](const string &u) {
+        return cache->values.find(u) != cache->values.end();
+      });
+    gate_t gate = c.getGate(root);
+
+    if(!c.isKnown(gate))
+      PG_RETURN_NULL();
+
+    unordered_map<gate_t, DatumValue> memo;
+    for(gate_t g{0}; g<c.getNbGates(); ++g) {
+      auto it = cache->values.find(c.getUUID(g));
+      if(it != cache->values.end())
+        memo[g] = it->second;
+    }
+
+    SPI_connect();
+
+    try {
+      UserSemiring semiring(c, *cache->mapping, element_type, {element_one, false},
+                            plus_function, times_function, monus_function, delta_function,
+                            PG_GET_COLLATION());
+      result = c.evaluate(gate, semiring, &memo);
+    } catch(CircuitException &e) {
+      elog(ERROR, "%s", e.what());
+    }
+
+    // Values computed in this call are moved to the cache before SPI
+    // memory is released
+    MemoryContext spi_context = MemoryContextSwitchTo(cache->context);
+    for(const auto &p: memo) {
+      auto u = c.getUUID(p.first);
+      if(cache->values.find(u) != cache->values.end())
+        continue;
+
+      DatumValue v = p.second;
+      if(!v.isnull)
+        v.value = datumCopy(v.value, cache->typbyval, cache->typlen);
+      cache->values[u] = v;
+    }
+    MemoryContextSwitchTo(spi_context);
+
+    SPI_finish();
+
+    result = cache->values[root];
+  }
+
+  if(result.isnull)
+    PG_RETURN_NULL();
+  else
+    PG_RETURN_DATUM(datumCopy(result.value, cache->typbyval, cache->typlen));
+}
+
+Datum provenance_evaluate(PG_FUNCTION_ARGS)
+{
+  if(PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2) || PG_ARGISNULL(3) || PG_ARGISNULL(4))
+    PG_RETURN_NULL();
+
+  return provenance_evaluate_internal(
+    fcinfo,
+    *DatumGetUUIDP(PG_GETARG_DATUM(0)),
+    PG_GETARG_OID(1),
+    get_fn_expr_argtype(fcinfo->flinfo, 2),
+    PG_GETARG_DATUM(2),
+    PG_GETARG_OID(3),
+    PG_GETARG_OID(4),
+    PG_ARGISNULL(5)?InvalidOid:PG_GETARG_OID(5),
+    PG_ARGISNULL(6)?InvalidOid:PG_GETARG_OID(6));
+}
@@ -0,0 +1,128 @@
+extern "C" {
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "utils/builtins.h"
+#include "utils/uuid.h"
+
+#include "provsql_shmem.h"
+#include "provsql_utils.h"
+
+PG_FUNCTION_INFO_V1(provenance_evaluate_builtin);
+}
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GenericCircuit.hpp"
+#include "BuiltinSemirings.h"
+#include "CircuitFromShMem.h"
+#include "ProvenanceMapping.h"
+#include "provsql_utils_cpp.h"
+
+using namespace std;
+
+// Read the values associated to the input gates of the circuit in the
+// provenance mapping; when the values are of an enumerated type, its
+// labels are also returned, in order
+static void read_mapping(
+  GenericCircuit &c,
+  Oid token2value,
+  unordered_map<gate_t, string> &mapping,
+  vector<string> &labels)
+{
+  vector<gate_t> inputs;
+  vector<pg_uuid_t> tokens;
+
+  for(gate_t g{0}; g<c.getNbGates(); ++g)
+    if(c.isKnown(g) && (c.getGateType(g) == gate_input || c.getGateType(g) == gate_mulinput)) {
+      inputs.push_back(g);
+      tokens.push_back(string2uuid(c.getUUID(g)));
+    }
+
+  if(inputs.empty())
+    return;
+
+  ProvenanceMapping values(token2value, CurrentMemoryContext);
+
+  SPI_connect();
+
+  values.load(tokens);
+
+  for(unsigned i=0; i<inputs.size(); ++i) {
+    DatumValue v;
+    if(values.lookup(tokens[i], v) && !v.isnull)
+      mapping[inputs[i]] = values.toString(v);
+  }
+
+  Datum type_arg = ObjectIdGetDatum(values.getType());
+  Oid type_argtype = OIDOID;
+  if(SPI_execute_with_args(
+       "SELECT enumlabel::text FROM pg_enum WHERE enumtypid=$1 ORDER BY enumsortorder",
+       1, &type_argtype, &type_arg, NULL, true, 0) != SPI_OK_SELECT)
+    elog(ERROR, "Cannot read enumerated type");
+
+  for(uint64 i = 0; i < SPI_processed; ++i)
+    labels.push_back(SPI_getvalue(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1));
+
+  SPI_finish();
+}
+
+template<typename S>
+static string evaluate(const GenericCircuit &c, gate_t g, S &&semiring)
+{
+  return semiring.toString(c.evaluate(g, semiring));
+}
+
+Datum provenance_evaluate_builtin(PG_FUNCTION_ARGS)
+{
+  if(PG_ARGISNULL(0) || PG_ARGISNULL(1))
+    PG_RETURN_NULL();
+
+  pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
+  string semiring = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+  GenericCircuit c = createGenericCircuit(token);
+  gate_t gate = c.getGate(uuid2string(token));
+
+  if(!c.isKnown(gate))
+    PG_RETURN_NULL();
+
+  unordered_map<gate_t, string> mapping;
+  vector<string> labels;
+  if(!PG_ARGISNULL(2))
+    read_mapping(c, PG_GETARG_OID(2), mapping, labels);
+
+  string result;
+
+  try {
+    if(semiring == "counting")
+      result = evaluate(c, gate, CountingSemiring(mapping));
+    else if(semiring == "boolean")
+      result = evaluate(c, gate, BooleanSemiring(mapping));
+    else if(semiring == "why")
+      result = evaluate(c, gate, WhySemiring(mapping));
+    else if(semiring == "formula")
+      result = evaluate(c, gate, FormulaSemiring(mapping));
+    else if(semiring == "tropical")
+      result = evaluate(c, gate, TropicalSemiring(mapping));
+    else if(semiring == "viterbi")
+      result = evaluate(c, gate, ViterbiSemiring(mapping));
+    else if(semiring == "security") {
+      if(labels.empty())
+        elog(ERROR, "The security semiring requires a provenance mapping to an enumerated type");
+      result = evaluate(c, gate, SecuritySemiring(mapping, labels));
+    } else
+      elog(ERROR, "Unknown built-in semiring '%s'", semiring.c_str());
+  } catch(CircuitException &e) {
+    elog(ERROR, "%s", e.what());
+  } catch(std::logic_error &e) {
+    // Raised by std::stoll and std::stod on values of the mapping
+    elog(ERROR, "Invalid value in provenance mapping for semiring '%s'", semiring.c_str());
+  }
+
+  PG_RETURN_TEXT_P(cstring_to_text_with_len(result.c_str(), result.size()));
+}
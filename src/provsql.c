@@ -35,6 +35,7 @@ PG_MODULE_MAGIC;
 bool provsql_interrupted = false;
 bool provsql_where_provenance = false;
 int provsql_verbose = 100;
+char *provsql_scenario = NULL;
 
 static const char *PROVSQL_COLUMN_NAME = "provsql";
 
@@ -817,6 +818,7 @@ static Query *check_for_agg_distinct(Query *q){
   List* lst_v = NIL;
   Query* new_q = copyObject(q);
   unsigned char found = 0;
+  unsigned char mixed = 0;
 
   //replace each Aggref with a TargetEntry calling the agg function
   //-- only in the top-level of the query
@@ -842,7 +844,8 @@ static Query *check_for_agg_distinct(Query *q){
         lst_v = lappend(lst_v, te_new);
       }
       else {
-        lst_v = lappend(lst_v, ar_v);
+        lst_v = lappend(lst_v, te_v);
+        mixed = 1;
       }
     } else {   //keep the current TE
       lst_v = lappend(lst_v, te_v);
@@ -850,6 +853,8 @@ static Query *check_for_agg_distinct(Query *q){
   }
   if(lst_v!=NIL) new_q->targetList = lst_v;
   if(!found) return NULL;
+  else if(mixed)
+    ereport(ERROR, (errmsg("Aggregates with and without DISTINCT in the same query not supported by provsql")));
   else return new_q;
 }
 
@@ -1609,6 +1614,17 @@ void _PG_init(void)
                           NULL,
                           NULL);
 
+  DefineCustomStringVariable("provsql.scenario",
+                             "Probability scenario used by probability computations",
+                             "Name of a scenario defined with set_scenario_probs, empty (default) for the probabilities set with set_prob.",
+                             &provsql_scenario,
+                             "",
+                             PGC_USERSET,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+
   DefineCustomIntVariable("provsql.max_nb_gates",
                           "Maximum number of gates kept in memory",
                           NULL,
@@ -1645,6 +1661,31 @@ void _PG_init(void)
                           NULL,
                           NULL,
                           NULL);
+  DefineCustomIntVariable("provsql.avg_extra_size",
+                          "Average size in bytes of extra gate information kept in memory",
+                          NULL,
+                          &provsql_avg_extra_size,
+                          8,
+                          1,
+                          1000,
+                          PGC_POSTMASTER,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
+
+  DefineCustomIntVariable("provsql.max_nb_scenario_probs",
+                          "Maximum number of probabilities of named scenarios kept in memory",
+                          NULL,
+                          &provsql_max_nb_scenario_probs,
+                          1000000,
+                          1000,
+                          INT_MAX,
+                          PGC_POSTMASTER,
+                          0,
+                          NULL,
+                          NULL,
+                          NULL);
 
   // Emit warnings for undeclared provsql.* configuration parameters
   EmitWarningsOnPlaceholders("provsql");
@@ -5,10 +5,12 @@
 #include "funcapi.h"
 #include "miscadmin.h"
 #include "access/htup_details.h"
+#include "catalog/pg_type.h"
 #include "parser/parse_func.h"
 #include "storage/shmem.h"
 #include "storage/fd.h"
 #include "utils/array.h"
+#include "utils/builtins.h"
 #include "utils/hsearch.h"
 #include "utils/uuid.h"
 
@@ -25,17 +27,31 @@ shmem_request_hook_type prev_shmem_request = NULL;
 int provsql_init_nb_gates;
 int provsql_max_nb_gates;
 int provsql_avg_nb_wires;
+int provsql_avg_extra_size;
+int provsql_max_nb_scenario_probs;
 
 static void provsql_shmem_shutdown(int code, Datum arg);
 
 provsqlSharedState *provsql_shared_state = NULL;
 HTAB *provsql_hash = NULL;
+HTAB *provsql_scenario_hash = NULL;
 provsqlHashEntry *entry;
 
+Size provsql_wires_size(void)
+{
+  return mul_size(sizeof(pg_uuid_t), ((Size) provsql_max_nb_gates) * provsql_avg_nb_wires);
+}
+
+Size provsql_extra_size(void)
+{
+  return ((Size) provsql_max_nb_gates) * provsql_avg_extra_size;
+}
+
 static Size provsql_struct_size(void)
 {
-  return add_size(offsetof(provsqlSharedState, wires),
-                  mul_size(sizeof(pg_uuid_t), ((Size) provsql_max_nb_gates) * provsql_avg_nb_wires));
+  return add_size(add_size(offsetof(provsqlSharedState, wires),
+                           provsql_wires_size()),
+                  provsql_extra_size());
 }
 
 uint32 provsql_hash_uuid(const void *key, Size s)
@@ -44,6 +60,13 @@ uint32 provsql_hash_uuid(const void *key, Size s)
   return *(uint32*)key;
 }
 
+static uint32 provsql_hash_scenario(const void *key, Size s)
+{
+  const provsqlScenarioKey *k = (const provsqlScenarioKey *) key;
+  (void)s;
+  return *(uint32*)&k->token ^ k->scenario;
+}
+
 void provsql_shmem_startup(void)
 {
   bool found;
@@ -55,6 +78,7 @@ void provsql_shmem_startup(void)
   // Reset in case of restart
   provsql_shared_state = NULL;
   provsql_hash = NULL;
+  provsql_scenario_hash = NULL;
 
 
   LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
@@ -72,6 +96,10 @@ void provsql_shmem_startup(void)
     provsql_shared_state->lock =LWLockAssign();
 #endif /* PG_VERSION_NUM >= 90600 */
     provsql_shared_state->nb_wires=0;
+    provsql_shared_state->nb_extra=0;
+    provsql_shared_state->extra_offset=offsetof(provsqlSharedState, wires)+provsql_wires_size();
+    memset(provsql_shared_state->progress, 0, sizeof(provsql_shared_state->progress));
+    memset(provsql_shared_state->scenarios, 0, sizeof(provsql_shared_state->scenarios));
   }
 
   memset(&info, 0, sizeof(info));
@@ -87,6 +115,19 @@ void provsql_shmem_startup(void)
     HASH_ELEM | HASH_FUNCTION
     );
 
+  memset(&info, 0, sizeof(info));
+  info.keysize = sizeof(provsqlScenarioKey);
+  info.entrysize = sizeof(provsqlScenarioEntry);
+  info.hash = provsql_hash_scenario;
+
+  provsql_scenario_hash = ShmemInitHash(
+    "provsql scenario hash",
+    Min(provsql_init_nb_gates, provsql_max_nb_scenario_probs),
+    provsql_max_nb_scenario_probs,
+    &info,
+    HASH_ELEM | HASH_FUNCTION
+    );
+
   LWLockRelease(AddinShmemInitLock);
 
   // If we are in the main process, we set up a shutdown hook
@@ -156,6 +197,9 @@ Size provsql_memsize(void)
   // Size of the array of wire ends
   size = add_size(size,
                   hash_estimate_size(provsql_max_nb_gates, sizeof(provsqlHashEntry)));
+  // Size of the hash table of probabilities in scenarios
+  size = add_size(size,
+                  hash_estimate_size(provsql_max_nb_scenario_probs, sizeof(provsqlScenarioEntry)));
 
   return size;
 }
@@ -228,6 +272,7 @@ Datum create_gate(PG_FUNCTION_ARGS)
       entry->prob = NAN;
 
     entry->info1 = entry->info2 = 0;
+    entry->extra_idx = entry->extra_len = 0;
   }
 
   LWLockRelease(provsql_shared_state->lock);
@@ -235,6 +280,76 @@ Datum create_gate(PG_FUNCTION_ARGS)
   PG_RETURN_VOID();
 }
 
+void provsql_create_input_gates(const pg_uuid_t *tokens, unsigned nb)
+{
+  LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+
+  for(unsigned i=0; i<nb; ++i) {
+    provsqlHashEntry *entry;
+    bool found;
+
+    if(hash_get_num_entries(provsql_hash) == provsql_max_nb_gates) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Too many gates in in-memory circuit");
+    }
+
+    entry = (provsqlHashEntry *) hash_search_with_hash_value(provsql_hash, &tokens[i], *(uint32*)&tokens[i], HASH_ENTER, &found);
+
+    if(!found) {
+      entry->type = gate_input;
+      entry->nb_children = 0;
+      entry->children_idx = provsql_shared_state->nb_wires;
+      entry->prob = NAN;
+      entry->info1 = entry->info2 = 0;
+      entry->extra_idx = entry->extra_len = 0;
+    }
+  }
+
+  LWLockRelease(provsql_shared_state->lock);
+}
+
+void provsql_create_mulinput_gates(const pg_uuid_t *tokens, const pg_uuid_t *keys, const double *probs, const unsigned *indexes, unsigned nb)
+{
+  LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+
+  for(unsigned i=0; i<nb; ++i) {
+    provsqlHashEntry *entry;
+    bool found;
+
+    if(hash_get_num_entries(provsql_hash) == provsql_max_nb_gates) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Too many gates in in-memory circuit");
+    }
+
+    entry = (provsqlHashEntry *) hash_search_with_hash_value(provsql_hash, &tokens[i], *(uint32*)&tokens[i], HASH_ENTER, &found);
+
+    if(!found) {
+      if(provsql_shared_state->nb_wires + 1 > provsql_max_nb_gates * provsql_avg_nb_wires) {
+        hash_search(provsql_hash, &tokens[i], HASH_REMOVE, &found);
+        LWLockRelease(provsql_shared_state->lock);
+        elog(ERROR, "Too many wires in in-memory circuit");
+      }
+
+      entry->type = gate_mulinput;
+      entry->nb_children = 1;
+      entry->children_idx = provsql_shared_state->nb_wires;
+      provsql_shared_state->wires[provsql_shared_state->nb_wires++] = keys[i];
+      entry->info2 = 0;
+      entry->extra_idx = entry->extra_len = 0;
+    }
+
+    if(entry->type != gate_mulinput) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Probability can only be assigned to input token");
+    }
+
+    entry->prob = probs[i];
+    entry->info1 = indexes[i];
+  }
+
+  LWLockRelease(provsql_shared_state->lock);
+}
+
 PG_FUNCTION_INFO_V1(set_prob);
 Datum set_prob(PG_FUNCTION_ARGS)
 {
@@ -268,6 +383,35 @@ Datum set_prob(PG_FUNCTION_ARGS)
   PG_RETURN_VOID();
 }
 
+void provsql_set_probs(const pg_uuid_t *tokens, const double *probs, unsigned nb)
+{
+  LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+
+  for(unsigned i=0; i<nb; ++i) {
+    provsqlHashEntry *entry;
+    bool found;
+
+    if(isnan(probs[i]))
+      continue;
+
+    entry = (provsqlHashEntry *) hash_search(provsql_hash, &tokens[i], HASH_FIND, &found);
+
+    if(!found) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Unknown gate");
+    }
+
+    if(entry->type != gate_input && entry->type != gate_mulinput) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Probability can only be assigned to input token");
+    }
+
+    entry->prob = probs[i];
+  }
+
+  LWLockRelease(provsql_shared_state->lock);
+}
+
 PG_FUNCTION_INFO_V1(set_infos);
 Datum set_infos(PG_FUNCTION_ARGS)
 {
@@ -290,19 +434,23 @@ Datum set_infos(PG_FUNCTION_ARGS)
     elog(ERROR, "Unknown gate");
   }
 
-  if(entry->type == gate_eq && PG_ARGISNULL(2)) {
+  if((entry->type == gate_eq || entry->type == gate_agg) && PG_ARGISNULL(2)) {
     LWLockRelease(provsql_shared_state->lock);
     elog(ERROR, "Invalid NULL value passed to set_infos");
   }
 
-  if(entry->type != gate_eq && entry->type != gate_mulinput) {
+  if(entry->type != gate_eq && entry->type != gate_agg && entry->type != gate_mulinput) {
     LWLockRelease(provsql_shared_state->lock);
     elog(ERROR, "Infos cannot be assigned to this gate type");
   }
 
-  entry->info1 = info1;
-  if(entry->type == gate_eq)
-    entry->info2 = info2;
+  // The aggregate function and type of an agg gate are set by the
+  // first aggregation that creates it, as for its extra information
+  if(entry->type != gate_agg || entry->info1 == 0) {
+    entry->info1 = info1;
+    if(entry->type == gate_eq || entry->type == gate_agg)
+      entry->info2 = info2;
+  }
 
   LWLockRelease(provsql_shared_state->lock);
 
@@ -391,15 +539,19 @@ Datum get_prob(PG_FUNCTION_ARGS)
   provsqlHashEntry *entry;
   bool found;
   double result = NAN;
+  int scenario;
 
   if(PG_ARGISNULL(0))
     PG_RETURN_NULL();
 
   LWLockAcquire(provsql_shared_state->lock, LW_SHARED);
 
+  // Probability in the active scenario, if any
+  scenario = provsql_find_scenario(provsql_scenario);
+
   entry = (provsqlHashEntry *) hash_search(provsql_hash, token, HASH_FIND, &found);
   if(found)
-    result = entry->prob;
+    result = provsql_scenario_prob(entry, scenario);
 
   LWLockRelease(provsql_shared_state->lock);
 
@@ -409,6 +561,189 @@ Datum get_prob(PG_FUNCTION_ARGS)
     PG_RETURN_FLOAT8(result);
 }
 
+int provsql_find_scenario(const char *name)
+{
+  if(name == NULL || name[0] == '\0')
+    return -1;
+
+  for(int i=0; i<PROVSQL_NB_SCENARIOS; ++i)
+    if(strncmp(provsql_shared_state->scenarios[i], name, NAMEDATALEN) == 0)
+      return i;
+
+  LWLockRelease(provsql_shared_state->lock);
+  elog(ERROR, "Unknown probability scenario %s", name);
+  return -1;
+}
+
+double provsql_scenario_prob(const provsqlHashEntry *entry, int scenario)
+{
+  provsqlScenarioKey key;
+  provsqlScenarioEntry *e;
+  bool found;
+
+  if(scenario < 0)
+    return entry->prob;
+
+  memset(&key, 0, sizeof(key));
+  key.token = entry->key;
+  key.scenario = scenario;
+
+  e = (provsqlScenarioEntry *) hash_search(provsql_scenario_hash, &key, HASH_FIND, &found);
+
+  return found ? e->prob : entry->prob;
+}
+
+PG_FUNCTION_INFO_V1(set_scenario_probs);
+Datum set_scenario_probs(PG_FUNCTION_ARGS)
+{
+  char *name;
+  ArrayType *tokens_array, *probs_array;
+  Datum *tokens, *probs;
+  bool *tokens_nulls, *probs_nulls;
+  int nb_tokens, nb_probs;
+  int scenario = -1;
+  long nb_new = 0;
+  constants_t constants;
+
+  if(PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2))
+    elog(ERROR, "Invalid NULL value passed to set_scenario_probs");
+
+  name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  if(name[0] == '\0')
+    elog(ERROR, "Invalid empty scenario name");
+  if(strlen(name) >= NAMEDATALEN)
+    elog(ERROR, "Scenario name %s too long", name);
+
+  tokens_array = PG_GETARG_ARRAYTYPE_P(1);
+  probs_array = PG_GETARG_ARRAYTYPE_P(2);
+  constants = initialize_constants(true);
+  deconstruct_array(tokens_array, constants.OID_TYPE_UUID, UUID_LEN, false, 'c',
+                    &tokens, &tokens_nulls, &nb_tokens);
+  deconstruct_array(probs_array, FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL, 'd',
+                    &probs, &probs_nulls, &nb_probs);
+  if(nb_tokens != nb_probs)
+    elog(ERROR, "Arrays of tokens and probabilities of different lengths passed to set_scenario_probs");
+
+  for(int i=0; i<nb_probs; ++i) {
+    double p;
+
+    if(probs_nulls[i])
+      continue;
+
+    p = DatumGetFloat8(probs[i]);
+    if(isnan(p) || p < 0. || p > 1.)
+      elog(ERROR, "Invalid probability %g passed to set_scenario_probs", p);
+  }
+
+  LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+
+  for(int i=0; i<PROVSQL_NB_SCENARIOS; ++i) {
+    if(strcmp(provsql_shared_state->scenarios[i], name) == 0) {
+      scenario = i;
+      break;
+    } else if(scenario < 0 && provsql_shared_state->scenarios[i][0] == '\0')
+      scenario = i;
+  }
+
+  if(scenario < 0) {
+    LWLockRelease(provsql_shared_state->lock);
+    elog(ERROR, "Too many probability scenarios");
+  }
+
+  // All tokens are checked, and the room needed for their probabilities
+  // is bounded, before the slot of the scenario is claimed and anything
+  // is modified
+  for(int i=0; i<nb_tokens; ++i) {
+    provsqlHashEntry *entry;
+    provsqlScenarioKey key;
+    bool found;
+
+    if(tokens_nulls[i] || probs_nulls[i])
+      continue;
+
+    entry = (provsqlHashEntry *) hash_search(provsql_hash, DatumGetUUIDP(tokens[i]), HASH_FIND, &found);
+
+    if(!found) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Unknown gate");
+    }
+
+    if(entry->type != gate_input && entry->type != gate_mulinput) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Probability can only be assigned to input token");
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.token = entry->key;
+    key.scenario = scenario;
+
+    hash_search(provsql_scenario_hash, &key, HASH_FIND, &found);
+    if(!found)
+      ++nb_new;
+  }
+
+  if(hash_get_num_entries(provsql_scenario_hash) + nb_new > provsql_max_nb_scenario_probs) {
+    LWLockRelease(provsql_shared_state->lock);
+    elog(ERROR, "Too many probabilities in in-memory scenarios");
+  }
+
+  strcpy(provsql_shared_state->scenarios[scenario], name);
+
+  for(int i=0; i<nb_tokens; ++i) {
+    provsqlScenarioKey key;
+    provsqlScenarioEntry *e;
+    bool found;
+
+    if(tokens_nulls[i] || probs_nulls[i])
+      continue;
+
+    memset(&key, 0, sizeof(key));
+    key.token = *DatumGetUUIDP(tokens[i]);
+    key.scenario = scenario;
+
+    e = (provsqlScenarioEntry *) hash_search(provsql_scenario_hash, &key, HASH_ENTER, &found);
+    e->prob = DatumGetFloat8(probs[i]);
+  }
+
+  LWLockRelease(provsql_shared_state->lock);
+
+  PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(drop_scenario);
+Datum drop_scenario(PG_FUNCTION_ARGS)
+{
+  char *name;
+  int scenario;
+  HASH_SEQ_STATUS hash_seq;
+  provsqlScenarioEntry *e;
+
+  if(PG_ARGISNULL(0))
+    elog(ERROR, "Invalid NULL value passed to drop_scenario");
+
+  name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+
+  LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+
+  scenario = provsql_find_scenario(name);
+  if(scenario < 0) {
+    LWLockRelease(provsql_shared_state->lock);
+    elog(ERROR, "Invalid empty scenario name");
+  }
+
+  // Removing the entry just returned by hash_seq_search is allowed
+  hash_seq_init(&hash_seq, provsql_scenario_hash);
+  while((e = (provsqlScenarioEntry *) hash_seq_search(&hash_seq)) != NULL)
+    if(e->key.scenario == scenario)
+      hash_search(provsql_scenario_hash, &e->key, HASH_REMOVE, NULL);
+
+  provsql_shared_state->scenarios[scenario][0] = '\0';
+
+  LWLockRelease(provsql_shared_state->lock);
+
+  PG_RETURN_VOID();
+}
+
 PG_FUNCTION_INFO_V1(get_infos);
 Datum get_infos(PG_FUNCTION_ARGS)
 {
@@ -416,6 +751,7 @@ Datum get_infos(PG_FUNCTION_ARGS)
   provsqlHashEntry *entry;
   bool found;
   unsigned info1 =0, info2 = 0;
+  gate_type type = gate_input;
 
   if(PG_ARGISNULL(0))
     PG_RETURN_NULL();
@@ -426,6 +762,7 @@ Datum get_infos(PG_FUNCTION_ARGS)
   if(found) {
     info1 = entry->info1;
     info2 = entry->info2;
+    type = entry->type;
   }
 
   LWLockRelease(provsql_shared_state->lock);
@@ -442,15 +779,94 @@ Datum get_infos(PG_FUNCTION_ARGS)
 
     nulls[0] = false;
     values[0] = Int32GetDatum(info1);
-    if(entry->type == gate_eq) {
+    if(type == gate_eq || type == gate_agg) {
       nulls[1] = false;
       values[1] = Int32GetDatum(info2);
     } else
-      nulls[1] = (entry->type != gate_eq);
+      nulls[1] = true;
 
     PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
   }
 }
+PG_FUNCTION_INFO_V1(set_extra);
+Datum set_extra(PG_FUNCTION_ARGS)
+{
+  pg_uuid_t *token;
+  text *data;
+  unsigned len;
+  provsqlHashEntry *entry;
+  bool found;
+
+  if(PG_ARGISNULL(0))
+    elog(ERROR, "Invalid NULL value passed to set_extra");
+
+  token = DatumGetUUIDP(PG_GETARG_DATUM(0));
+
+  if(PG_ARGISNULL(1)) {
+    data = NULL;
+    len = 0;
+  } else {
+    data = PG_GETARG_TEXT_PP(1);
+    len = VARSIZE_ANY_EXHDR(data);
+  }
+
+  LWLockAcquire(provsql_shared_state->lock, LW_EXCLUSIVE);
+
+  entry = (provsqlHashEntry *) hash_search(provsql_hash, token, HASH_FIND, &found);
+
+  if(!found) {
+    LWLockRelease(provsql_shared_state->lock);
+    elog(ERROR, "Unknown gate");
+  }
+
+  // Extra information is determined by the gate token, it is only
+  // stored once
+  if(entry->extra_len == 0 && len > 0) {
+    if(provsql_shared_state->nb_extra + (Size) len > provsql_extra_size()) {
+      LWLockRelease(provsql_shared_state->lock);
+      elog(ERROR, "Too much extra information in in-memory circuit");
+    }
+
+    memcpy(provsql_extra() + provsql_shared_state->nb_extra, VARDATA_ANY(data), len);
+    entry->extra_idx = provsql_shared_state->nb_extra;
+    entry->extra_len = len;
+    provsql_shared_state->nb_extra += len;
+  } else if(entry->extra_len == 0 && data == NULL) {
+    entry->extra_len = PROVSQL_EXTRA_NULL;
+  }
+
+  LWLockRelease(provsql_shared_state->lock);
+
+  PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(get_extra);
+Datum get_extra(PG_FUNCTION_ARGS)
+{
+  pg_uuid_t *token;
+  provsqlHashEntry *entry;
+  bool found;
+  text *result = NULL;
+
+  if(PG_ARGISNULL(0))
+    PG_RETURN_NULL();
+
+  token = DatumGetUUIDP(PG_GETARG_DATUM(0));
+
+  LWLockAcquire(provsql_shared_state->lock, LW_SHARED);
+
+  entry = (provsqlHashEntry *) hash_search(provsql_hash, token, HASH_FIND, &found);
+  if(found && entry->extra_len != PROVSQL_EXTRA_NULL)
+    result = cstring_to_text_with_len(provsql_extra() + entry->extra_idx, entry->extra_len);
+
+  LWLockRelease(provsql_shared_state->lock);
+
+  if(result == NULL)
+    PG_RETURN_NULL();
+  else
+    PG_RETURN_TEXT_P(result);
+}
+
 void provsql_shmem_request(void)
 {
 #if (PG_VERSION_NUM >= 150000)
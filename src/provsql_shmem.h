@@ -16,20 +16,53 @@ extern shmem_request_hook_type prev_shmem_request;
 extern int provsql_init_nb_gates;
 extern int provsql_max_nb_gates;
 extern int provsql_avg_nb_wires;
+extern int provsql_avg_extra_size;
+extern int provsql_max_nb_scenario_probs;
 
 uint32 provsql_hash_uuid(const void *key, Size s);
 void provsql_shmem_startup(void);
 Size provsql_memsize(void);
 void provsql_shmem_request(void);
 
+/* Maximal number of concurrent bulk add_provenance operations whose
+ * progress is reported */
+#define PROVSQL_NB_PROGRESS_SLOTS 16
+
+typedef struct provsqlProgress
+{
+  int pid; // backend running the operation, 0 if the slot is free
+  Oid relid;
+  int64 tuples_total; // estimate, from pg_class.reltuples
+  int64 tuples_done;
+} provsqlProgress;
+
+/* Maximal number of named probability scenarios */
+#define PROVSQL_NB_SCENARIOS 32
+
 typedef struct provsqlSharedState
 {
   LWLock *lock; // protect access to the shared data
   unsigned nb_wires;
+  unsigned nb_extra;
+  Size extra_offset; // offset of the arena of variable-length extra information, stored after the wires
+  provsqlProgress progress[PROVSQL_NB_PROGRESS_SLOTS];
+  char scenarios[PROVSQL_NB_SCENARIOS][NAMEDATALEN]; // names of the scenarios, empty for free slots
   pg_uuid_t wires[FLEXIBLE_ARRAY_MEMBER];
 } provsqlSharedState;
 extern provsqlSharedState *provsql_shared_state;
 
+/* Arena of extra information; located through an offset from the
+ * shared state, which is valid whatever the address at which shared
+ * memory is mapped in a process */
+static inline char *provsql_extra(void)
+{
+  return ((char *) provsql_shared_state) + provsql_shared_state->extra_offset;
+}
+
+/* Capacities, in bytes, of the arrays of wires and of extra information */
+Size provsql_wires_size(void);
+Size provsql_extra_size(void);
+
 typedef struct provsqlHashEntry
 {
   pg_uuid_t key;
@@ -39,9 +72,52 @@ typedef struct provsqlHashEntry
   double prob;
   unsigned info1;
   unsigned info2;
+  unsigned extra_idx;
+  unsigned extra_len;
 } provsqlHashEntry;
 extern HTAB *provsql_hash;
 
+/* Value of extra_len for gates whose extra information is the NULL
+ * value, as for value gates of NULL values */
+#define PROVSQL_EXTRA_NULL UINT_MAX
+
+/* Probability of an input or mulinput gate in a named scenario, which
+ * takes precedence over the probability of the gate when this scenario
+ * is the active one */
+typedef struct provsqlScenarioKey
+{
+  pg_uuid_t token;
+  unsigned scenario; // index in provsql_shared_state->scenarios
+} provsqlScenarioKey;
+
+typedef struct provsqlScenarioEntry
+{
+  provsqlScenarioKey key;
+  double prob;
+} provsqlScenarioEntry;
+extern HTAB *provsql_scenario_hash;
+
+/* Index of the scenario with that name, -1 for the empty name; raises
+ * an error if there is no such scenario. The lock must be held, it is
+ * released before raising the error. */
+int provsql_find_scenario(const char *name);
+
+/* Probability of a gate in a scenario, as returned by
+ * provsql_find_scenario; the lock must be held */
+double provsql_scenario_prob(const provsqlHashEntry *entry, int scenario);
+
+/* Register input gates for all given tokens, taking the lock only once;
+ * tokens that already correspond to a gate are left untouched */
+void provsql_create_input_gates(const pg_uuid_t *tokens, unsigned nb);
+
+/* Register mulinput gates, each with the corresponding key token as
+ * only child, probability and index, taking the lock only once */
+void provsql_create_mulinput_gates(const pg_uuid_t *tokens, const pg_uuid_t *keys, const double *probs, const unsigned *indexes, unsigned nb);
+
+/* Set the probabilities of the input gates of all given tokens, taking
+ * the lock only once; NaN probabilities are skipped */
+void provsql_set_probs(const pg_uuid_t *tokens, const double *probs, unsigned nb);
+
 int provsql_serialize(const char*);
 int provsql_deserialize(const char*);
 
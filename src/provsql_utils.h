@@ -57,6 +57,7 @@ Oid find_equality_operator(Oid ltypeId, Oid rtypeId);
 extern bool provsql_interrupted;
 extern bool provsql_where_provenance;
 extern int provsql_verbose;
+extern char *provsql_scenario;
 
 constants_t initialize_constants(bool failure_if_not_possible);
 
@@ -6,10 +6,31 @@ extern "C" {
 #include "provsql_utils.h"
 }
 
+#include <cstring>
 #include <string>
 
 std::string UUIDDatum2string(Datum token);
 std::string uuid2string(pg_uuid_t uuid);
 pg_uuid_t string2uuid(const std::string &source);
 
+// Hashing and equality of binary UUIDs, for use in unordered containers
+struct UUIDHash {
+  size_t operator()(const pg_uuid_t &u) const {
+    size_t h;
+    memcpy(&h, u.data, sizeof(h));
+    return h;
+  }
+};
+struct UUIDEqual {
+  bool operator()(const pg_uuid_t &a, const pg_uuid_t &b) const {
+    return memcmp(a.data, b.data, UUID_LEN) == 0;
+  }
+};
+
+// A possibly NULL value of a PostgreSQL type
+struct DatumValue {
+  Datum value;
+  bool isnull;
+};
+
 #endif
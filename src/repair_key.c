@@ -0,0 +1,92 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/builtins.h"
+#include "utils/uuid.h"
+
+#include "provsql_shmem.h"
+
+/* Number of rows fetched from the cursor, and of mulinput gates stored
+ * in the in-memory circuit under a single lock acquisition */
+#define REPAIR_KEY_BATCH_SIZE 1000
+
+PG_FUNCTION_INFO_V1(repair_key_gates);
+
+/* Create the mulinput gates of a block-independent-disjoint table, in a
+ * single scan of the table: all tuples with the same value of the key
+ * form a block, sharing a fresh key token, and each tuple is given
+ * probability 1/(size of the block) and its rank in the block as index.
+ * The tokens of the tuples are read from the provsql_temp column. */
+Datum repair_key_gates(PG_FUNCTION_ARGS)
+{
+  Oid relid;
+  char *key_att;
+  StringInfoData query;
+  Portal portal;
+  pg_uuid_t tokens[REPAIR_KEY_BATCH_SIZE];
+  pg_uuid_t keys[REPAIR_KEY_BATCH_SIZE];
+  double probs[REPAIR_KEY_BATCH_SIZE];
+  unsigned indexes[REPAIR_KEY_BATCH_SIZE];
+  pg_uuid_t key_token;
+
+  if(PG_ARGISNULL(0))
+    elog(ERROR, "Invalid NULL value passed to repair_key_gates");
+
+  relid = PG_GETARG_OID(0);
+  key_att = PG_ARGISNULL(1)?"":text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+  initStringInfo(&query);
+  appendStringInfo(&query,
+                   "SELECT provsql_temp, count(*) OVER w, row_number() OVER w, "
+                   "CASE WHEN row_number() OVER w = 1 THEN public.uuid_generate_v4() END "
+                   "FROM %s ",
+                   DatumGetCString(DirectFunctionCall1(regclassout, ObjectIdGetDatum(relid))));
+  if(key_att[0] == '\0')
+    appendStringInfoString(&query, "WINDOW w AS ()");
+  else
+    appendStringInfo(&query, "WINDOW w AS (PARTITION BY %s)", key_att);
+
+  SPI_connect();
+
+  portal = SPI_cursor_open_with_args(NULL, query.data, 0, NULL, NULL, NULL, true, 0);
+
+  memset(&key_token, 0, sizeof(pg_uuid_t));
+
+  for(;;) {
+    unsigned nb = 0;
+
+    SPI_cursor_fetch(portal, true, REPAIR_KEY_BATCH_SIZE);
+    if(SPI_processed == 0)
+      break;
+
+    for(uint64 i = 0; i < SPI_processed; ++i) {
+      HeapTuple tuple = SPI_tuptable->vals[i];
+      TupleDesc tupdesc = SPI_tuptable->tupdesc;
+      bool isnull;
+      Datum token = SPI_getbinval(tuple, tupdesc, 1, &isnull);
+      int64 block_size = DatumGetInt64(SPI_getbinval(tuple, tupdesc, 2, &isnull));
+      int64 rank = DatumGetInt64(SPI_getbinval(tuple, tupdesc, 3, &isnull));
+      Datum new_key = SPI_getbinval(tuple, tupdesc, 4, &isnull);
+
+      if(rank == 1)
+        key_token = *DatumGetUUIDP(new_key);
+
+      tokens[nb] = *DatumGetUUIDP(token);
+      keys[nb] = key_token;
+      probs[nb] = 1./block_size;
+      indexes[nb] = rank;
+      ++nb;
+    }
+
+    SPI_freetuptable(SPI_tuptable);
+
+    provsql_create_mulinput_gates(tokens, keys, probs, indexes, nb);
+  }
+
+  SPI_cursor_close(portal);
+  SPI_finish();
+
+  PG_RETURN_VOID();
+}
@@ -16,6 +16,7 @@ PG_FUNCTION_INFO_V1(shapley_all_vars);
 #include "dDNNFTreeDecompositionBuilder.h"
 #include "CircuitFromShMem.h"
 #include <fstream>
+#include <unordered_map>
 
 using namespace std;
 
@@ -29,9 +30,8 @@ static double shapley_internal
 
   dDNNF dd = c.makeDD(c.getGate(uuid2string(token)), method, args);
 
-  dd.makeSmooth();
-  if(!banzhaf)
-    dd.makeGatesBinary(BooleanGate::AND);
+  if(banzhaf)
+    dd.makeSmooth();
 
   auto var_gate=dd.getGate(uuid2string(variable));
 
@@ -94,53 +94,55 @@ Datum shapley_all_vars(PG_FUNCTION_ARGS)
   rsinfo->returnMode = SFRM_Materialize;
   rsinfo->setResult = tupstore;
 
-  if(!PG_ARGISNULL(0)) {
-    pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
-
-    std::string method;
-    if(!PG_ARGISNULL(1)) {
-      text *t = PG_GETARG_TEXT_P(1);
-      method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
-    }
-
-    std::string args;
-    if(!PG_ARGISNULL(2)) {
-      text *t = PG_GETARG_TEXT_P(2);
-      args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
-    }
-
-    bool banzhaf = false;
-    if(!PG_ARGISNULL(3)) {
-      banzhaf = PG_GETARG_BOOL(3);
-    }
-
-    BooleanCircuit c = createBooleanCircuit(token);
-
-    dDNNF dd = c.makeDD(c.getGate(uuid2string(token)), method, args);
-    dd.makeSmooth();
-    if(!banzhaf)
-      dd.makeGatesBinary(BooleanGate::AND);
-
-    for(auto &v_circuit_gate: c.getInputs()) {
-      auto var_uuid_string = c.getUUID(v_circuit_gate);
-      auto var_gate=dd.getGate(var_uuid_string);
-      pg_uuid_t *uuidp = reinterpret_cast<pg_uuid_t*>(palloc(UUID_LEN));
-      *uuidp = string2uuid(var_uuid_string);
-
-      double result;
-
-      if(!banzhaf)
-        result = dd.shapley(var_gate);
-      else
-        result = dd.banzhaf(var_gate);
-
-      Datum values[2] = {
-        UUIDPGetDatum(uuidp), Float8GetDatum(result)
-      };
-      bool nulls[sizeof(values)] = {0, 0};
-
-      tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+  try {
+    if(!PG_ARGISNULL(0)) {
+      pg_uuid_t token = *DatumGetUUIDP(PG_GETARG_DATUM(0));
+
+      std::string method;
+      if(!PG_ARGISNULL(1)) {
+        text *t = PG_GETARG_TEXT_P(1);
+        method = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      std::string args;
+      if(!PG_ARGISNULL(2)) {
+        text *t = PG_GETARG_TEXT_P(2);
+        args = string(VARDATA(t),VARSIZE(t)-VARHDRSZ);
+      }
+
+      bool banzhaf = false;
+      if(!PG_ARGISNULL(3)) {
+        banzhaf = PG_GETARG_BOOL(3);
+      }
+
+      BooleanCircuit c = createBooleanCircuit(token);
+
+      dDNNF dd = c.makeDD(c.getGate(uuid2string(token)), method, args);
+      if(banzhaf)
+        dd.makeSmooth();
+
+      // Values of all variables are computed at once
+      std::unordered_map<gate_t, double> all_values =
+        banzhaf ? dd.banzhafAll() : dd.shapleyAll();
+
+      for(auto &v_circuit_gate: c.getInputs()) {
+        auto var_uuid_string = c.getUUID(v_circuit_gate);
+        auto var_gate=dd.getGate(var_uuid_string);
+        pg_uuid_t *uuidp = reinterpret_cast<pg_uuid_t*>(palloc(UUID_LEN));
+        *uuidp = string2uuid(var_uuid_string);
+
+        Datum values[2] = {
+          UUIDPGetDatum(uuidp), Float8GetDatum(all_values[var_gate])
+        };
+        bool nulls[sizeof(values)] = {0, 0};
+
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+      }
     }
+  } catch(const std::exception &e) {
+    elog(ERROR, "shapley_all_vars: %s", e.what());
+  } catch(...) {
+    elog(ERROR, "shapley_all_vars: Unknown exception");
   }
 
   tuplestore_donestoring(tupstore);
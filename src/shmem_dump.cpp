@@ -78,6 +78,8 @@ char* print_hash_entry(provsqlHashEntry* hash, char* buffer)
   "prob = %f\n"
   "info1 = %u\n"
   "info2 = %u\n"
+  "extra_idx = %u\n"
+  "extra_len = %u\n"
   ,
   //&hash->key,
   *&hash->type,
@@ -85,18 +87,26 @@ char* print_hash_entry(provsqlHashEntry* hash, char* buffer)
   *&hash->children_idx,
   *&hash->prob,
   *&hash->info1,
-  *&hash->info2
+  *&hash->info2,
+  *&hash->extra_idx,
+  *&hash->extra_len
   );
 
   return buffer;
 }
 
 
+// Marker and version at the start of dump files; the version is to be
+// incremented whenever the layout of the file changes
+static const int32 PROVSQL_DUMP_MAGIC = 0x50525653;
+static const int32 PROVSQL_DUMP_VERSION = 2;
+
 int provsql_serialize(const char* filename)
 {
   FILE *file;
   int32 num_entries;
   provsqlHashEntry *entry;
+  provsqlScenarioEntry *scenario_entry;
   HASH_SEQ_STATUS hash_seq;
 
   file = AllocateFile(filename, PG_BINARY_W);
@@ -105,6 +115,17 @@ int provsql_serialize(const char* filename)
     return 1;
   }
 
+  if (!fwrite(&PROVSQL_DUMP_MAGIC, sizeof(int32), 1, file) ||
+      !fwrite(&PROVSQL_DUMP_VERSION, sizeof(int32), 1, file))
+  {
+    if (FreeFile(file))
+    {
+      file = NULL;
+      return 4;
+    }
+    return 2;
+  }
+
   num_entries = hash_get_num_entries(provsql_hash);
   hash_seq_init(&hash_seq, provsql_hash);  
 
@@ -157,6 +178,64 @@ int provsql_serialize(const char* filename)
 
   }
 
+  if ( !fwrite( &(provsql_shared_state->nb_extra), sizeof(unsigned int), 1, file ))
+  {
+    if (FreeFile(file))
+    {
+      file = NULL;
+      return 4;
+    }
+    return 2;
+  }
+  if (provsql_shared_state->nb_extra > 0)
+  {
+    if (!fwrite( provsql_extra(), (unsigned long int)(provsql_shared_state->nb_extra), 1, file))
+    {
+     if (FreeFile(file))
+     {
+       file = NULL;
+       return 4;
+     }
+     return 2;
+    }
+  }
+
+  if (!fwrite(provsql_shared_state->scenarios, sizeof(provsql_shared_state->scenarios), 1, file))
+  {
+    if (FreeFile(file))
+    {
+      file = NULL;
+      return 4;
+    }
+    return 2;
+  }
+
+  num_entries = hash_get_num_entries(provsql_scenario_hash);
+  if (!fwrite(&num_entries, sizeof(int32), 1, file))
+  {
+    if (FreeFile(file))
+    {
+      file = NULL;
+      return 4;
+    }
+    return 2;
+  }
+
+  hash_seq_init(&hash_seq, provsql_scenario_hash);
+  while ( (scenario_entry = (provsqlScenarioEntry*)hash_seq_search(&hash_seq) )  != NULL )
+  {
+    if (!fwrite(scenario_entry, sizeof(provsqlScenarioEntry), 1, file))
+    {
+      hash_seq_term(&hash_seq);
+      if (FreeFile(file))
+      {
+        file = NULL;
+        return 4;
+      }
+      return 2;
+    }
+  }
+
   if (FreeFile(file))
   {
     file = NULL;
@@ -174,6 +253,8 @@ int provsql_deserialize(const char* filename)
 {
   FILE *file;
   int32 num;
+  int32 magic, version;
+  unsigned nb;
   provsqlHashEntry tmp;
   provsqlHashEntry *entry;
   bool found;
@@ -184,6 +265,16 @@ int provsql_deserialize(const char* filename)
     return 1;
   }
 
+  if (!fread(&magic, sizeof(int32), 1, file) ||
+      !fread(&version, sizeof(int32), 1, file))
+  {
+    return 2;
+  }
+
+  if (magic != PROVSQL_DUMP_MAGIC || version != PROVSQL_DUMP_VERSION)
+  {
+    return 4;
+  }
 
   if (!fread(&num, sizeof(int32),1,file))
   {
@@ -209,18 +300,85 @@ int provsql_deserialize(const char* filename)
     
   }
 
-  if (! fread(&provsql_shared_state->nb_wires, sizeof(unsigned int), 1, file ))
+  // Sizes are checked against the capacity of shared memory before
+  // anything is copied to it
+  if (! fread(&nb, sizeof(unsigned int), 1, file ))
   {
     return 2;
   }
 
-  if (provsql_shared_state->nb_wires  > 0) {
-    if (! fread(&provsql_shared_state->wires, sizeof(pg_uuid_t),(unsigned long int) (provsql_shared_state->nb_wires), file))
+  if (nb > provsql_wires_size() / sizeof(pg_uuid_t))
+  {
+    return 5;
+  }
+
+  if (nb > 0) {
+    if (fread(&provsql_shared_state->wires, sizeof(pg_uuid_t),(unsigned long int) nb, file) != nb)
     {
       return 2;
     }
   }
-  
+  provsql_shared_state->nb_wires = nb;
+
+  if (! fread(&nb, sizeof(unsigned int), 1, file ))
+  {
+    return 2;
+  }
+
+  if (nb > provsql_extra_size())
+  {
+    return 5;
+  }
+
+  if (nb > 0) {
+    if (! fread(provsql_extra(), (unsigned long int) nb, 1, file))
+    {
+      return 2;
+    }
+  }
+  provsql_shared_state->nb_extra = nb;
+
+  if (!fread(provsql_shared_state->scenarios, sizeof(provsql_shared_state->scenarios), 1, file))
+  {
+    return 2;
+  }
+
+  if (!fread(&num, sizeof(int32), 1, file))
+  {
+    return 2;
+  }
+
+  if (num < 0 || num > provsql_max_nb_scenario_probs)
+  {
+    return 5;
+  }
+
+  for (int i = 0; i < num; i++)
+  {
+    provsqlScenarioEntry scenario_tmp;
+    provsqlScenarioEntry *scenario_entry;
+
+    if (!fread(&scenario_tmp, sizeof(provsqlScenarioEntry), 1, file))
+    {
+      return 2;
+    }
+
+    if (scenario_tmp.key.scenario >= PROVSQL_NB_SCENARIOS)
+    {
+      return 4;
+    }
+
+    // Entries of the file are added to those already in memory, within
+    // the capacity of the hash table
+    hash_search(provsql_scenario_hash, &(scenario_tmp.key), HASH_FIND, &found);
+    if (!found && hash_get_num_entries(provsql_scenario_hash) >= provsql_max_nb_scenario_probs)
+    {
+      return 5;
+    }
+
+    scenario_entry = (provsqlScenarioEntry *) hash_search(provsql_scenario_hash, &(scenario_tmp.key), HASH_ENTER, &found);
+    scenario_entry->prob = scenario_tmp.prob;
+  }
 
   if (FreeFile(file))
   {
@@ -291,6 +449,14 @@ Datum read_data_dump(PG_FUNCTION_ARGS){
     elog(INFO, "Error while closing the file during deserialization");
     break;
 
+  case 4:
+    elog(INFO, "Unsupported format of the file during deserialization");
+    break;
+
+  case 5:
+    elog(INFO, "Content of the file too large for shared memory during deserialization");
+    break;
+
   }
 
   PG_RETURN_NULL();
@@ -2,7 +2,6 @@ extern "C"
 {
 #include "postgres.h"
 #include "fmgr.h"
-#include "catalog/pg_type.h"
 #include "utils/uuid.h"
 #include "executor/spi.h"
 #include "provsql_shmem.h"
@@ -11,37 +10,33 @@ extern "C"
 PG_FUNCTION_INFO_V1(view_circuit);
 }
 
+#include "CircuitFromShMem.h"
 #include "DotCircuit.h"
+#include "ProvenanceMapping.h"
+#include "provsql_utils_cpp.h"
 #include <csignal>
 #include <utility>
 #include <sstream>
 #include <algorithm>
+#include <unordered_set>
 
 using namespace std;
 
-static vector<pair<int, int> > parse_array(string s)
+static vector<int> parse_array(string s)
 {
   s = s.substr(1, s.size() - 2); // Remove initial '{' and final '}'
 
-  vector<pair<int, int> > result;
+  vector<int> result;
 
   istringstream iss(s);
   string p;
 
-  while(getline(iss, p, '}'))
+  while(getline(iss, p, ','))
   {
-    if(!p.empty() && p[0]==',')
-      p=p.substr(1);
-
-    int k = p.find(",", 1);
-    string s1 = p.substr(1, k - 1);
-    int i1;
-    if (s1 == "NULL")
-      i1 = 0;
+    if (p == "NULL")
+      result.push_back(0);
     else
-      i1 = stoi(p.substr(1, k - 1));
-    int i2 = stoi(p.substr(k + 1, p.size() - k));
-    result.push_back(make_pair(i1, i2));
+      result.push_back(stoi(p));
   }
 
   return result;
@@ -49,95 +44,84 @@ static vector<pair<int, int> > parse_array(string s)
 
 static std::string view_circuit_internal(Datum token, Datum token2prob, Datum is_debug)
 {
-  Datum arguments[2]={token,token2prob};
-  constants_t constants=initialize_constants(true);
-  Oid argtypes[2]={constants.OID_TYPE_UUID,REGCLASSOID};
-  char nulls[2] = {' ',' '};
+  GenericCircuit gc = createGenericCircuit(*DatumGetUUIDP(token));
+  gate_t root = gc.getGate(uuid2string(*DatumGetUUIDP(token)));
+  ProvenanceMapping mapping(DatumGetObjectId(token2prob), CurrentMemoryContext);
+  vector<pg_uuid_t> inputs;
+
+  for(gate_t g{0}; g<gc.getNbGates(); ++g)
+    if(gc.isKnown(g) && gc.getGateType(g) == gate_input)
+      inputs.push_back(string2uuid(gc.getUUID(g)));
 
   SPI_connect();
+  mapping.load(inputs);
+  SPI_finish();
 
   DotCircuit c;
 
-  int proc = 0;
+  // Gates are numbered in breadth-first order from the root, which is
+  // thus gate 0
+  vector<gate_t> to_process{root};
+  unordered_set<gate_t> processed{root};
+  c.getGate(gc.getUUID(root));
 
-  if (SPI_execute_with_args(
-        "SELECT * FROM provsql.sub_circuit_with_desc($1,$2)", 2, argtypes, arguments, nulls, true, 0) == SPI_OK_SELECT)
-  {
-    proc = SPI_processed;
-    TupleDesc tupdesc = SPI_tuptable->tupdesc;
-    SPITupleTable *tuptable = SPI_tuptable;
+  for(unsigned i=0; i<to_process.size(); ++i) {
+    gate_t g = to_process[i];
+    string f = gc.getUUID(g);
 
-    for (int i = 0; i < proc; i++)
-    {
-      HeapTuple tuple = tuptable->vals[i];
+    if(!gc.isKnown(g))
+      continue;
 
-      string f = SPI_getvalue(tuple, tupdesc, 1);
-      string type = SPI_getvalue(tuple, tupdesc, 3);
-      if (type == "input")
+    switch(gc.getGateType(g)) {
+    case gate_input:
+    {
+      DatumValue desc;
+      if(mapping.lookup(string2uuid(f), desc))
+        c.setGate(f, DotGate::IN, mapping.toString(desc));
+      break;
+    }
+    case gate_times:
+      c.setGate(f, DotGate::OTIMES);
+      break;
+    case gate_plus:
+      c.setGate(f, DotGate::OPLUS);
+      break;
+    case gate_monus:
+      c.setGate(f, DotGate::OMINUS);
+      break;
+    case gate_delta:
+      c.setGate(f, DotGate::DELTA);
+      break;
+    case gate_eq:
+    {
+      auto infos = gc.getInfos(g);
+      c.setGate(f, DotGate::EQ, to_string(infos.first) + "=" + to_string(infos.second));
+      break;
+    }
+    case gate_project:
+    {
+      if(gc.getExtra(g).empty())
+        elog(ERROR, "Missing extra information on project gate");
+      vector<int> v = parse_array(gc.getExtra(g));
+      std::string cond("(");
+      for (auto p : v)
       {
-        c.setGate(f, DotGate::IN, SPI_getvalue(tuple, tupdesc, 4));
-
-      } else {
-        auto id=c.getGate(f);
-
-        if (type == "times")
-        {
-          c.setGate(f, DotGate::OTIMES);
-        }
-        else if (type == "plus")
-        {
-          c.setGate(f, DotGate::OPLUS);
-        }
-        else if (type == "monus")
-        {
-          c.setGate(f, DotGate::OMINUS);
-        }
-        else if (type == "monusr")
-        {
-          c.setGate(f, DotGate::OMINUSR);
-        }
-        else if (type == "monusl")
-        {
-          c.setGate(f, DotGate::OMINUSL);
-        }
-        else if (type == "delta")
-        {
-          c.setGate(f, DotGate::DELTA);
-        }
-        else if (type == "eq")
-        {
-          vector<pair<int, int> > v = parse_array(SPI_getvalue(tuple, tupdesc, 5));
-          if (v.size() != 1)
-            elog(ERROR, "Incorrect extra information on eq gate");
-          std::string cond = std::to_string(v[0].first) + std::string("=") + std::to_string(v[0].second);
-          c.setGate(f, DotGate::EQ, cond);
-        }
-        else if (type == "project")
-        {
-          vector<pair<int, int> > v = parse_array(SPI_getvalue(tuple, tupdesc, 5));
-          sort(v.begin(), v.end(), [](auto &left, auto &right) {
-            return left.second < right.second;
-          });
-          std::string cond("(");
-          for (auto p : v)
-          {
-            cond += std::to_string(p.first) + ",";
-          }
-          std::string cond_final(cond.substr(0, cond.size() - 1) + ")");
-          //elog(WARNING, "PROJECT cond: %s", cond_final.c_str());
-          c.setGate(f, DotGate::PROJECT, cond_final);
-        }
-        else
-        {
-          elog(ERROR, "Wrong type of gate in circuit");
-        }
-        //elog(WARNING, "%d -- %d", id, c.getGate(SPI_getvalue(tuple, tupdesc, 2)));
-        c.addWire(id, c.getGate(SPI_getvalue(tuple, tupdesc, 2)));
+        cond += std::to_string(p) + ",";
       }
+      c.setGate(f, DotGate::PROJECT, cond.substr(0, cond.size() - 1) + ")");
+      break;
+    }
+    default:
+      elog(ERROR, "Wrong type of gate in circuit");
     }
-  }
 
-  SPI_finish();
+    auto id = c.getGate(f);
+    for(auto child: gc.getWires(g)) {
+      c.addWire(id, c.getGate(gc.getUUID(child)));
+      if(processed.insert(child).second)
+        to_process.push_back(child);
+    }
+  }
 
   // Display the circuit for debugging:
   int display = DatumGetInt64(is_debug);
@@ -22,28 +22,20 @@ PG_FUNCTION_INFO_V1(where_provenance);
 
 using namespace std;
 
-static vector<pair<int,int> > parse_array(string s)
+static vector<int> parse_array(string s)
 {
   s=s.substr(1,s.size()-2); // Remove initial '{' and final '}'
 
-  vector<pair<int,int> > result;
+  vector<int> result;
   istringstream iss(s);
   string p;
 
-  while(getline(iss, p, '}'))
+  while(getline(iss, p, ','))
   {
-    if(!p.empty() && p[0]==',')
-      p=p.substr(1);
-
-    int k=p.find(",",1);
-    string s1=p.substr(1,k-1);
-    int i1;
-    if(s1=="NULL")
-      i1=0;
+    if(p=="NULL")
+      result.push_back(0);
     else
-      i1=stoi(p.substr(1,k-1));
-    int i2=stoi(p.substr(k+1,p.size()-k));
-    result.push_back(make_pair(i1,i2));
+      result.push_back(stoi(p));
   }
 
   return result;
@@ -87,20 +79,16 @@ static string where_provenance_internal
         } else if(type == "plus") {
           c.setGate(f, WhereGate::PLUS);
         } else if(type == "project" || type == "eq") {
-          vector<pair<int,int> > v = parse_array(SPI_getvalue(tuple, tupdesc, 6));
+          char *infos = SPI_getvalue(tuple, tupdesc, 6);
+          if(!infos)
+            elog(ERROR, "Missing extra information on %s gate", type.c_str());
+          vector<int> v = parse_array(infos);
           if(type=="eq") {
-            if(v.size()!=1)
+            if(v.size()!=2)
               elog(ERROR, "Incorrect extra information on eq gate");
-            c.setGateEquality(f, v[0].first, v[0].second);
+            c.setGateEquality(f, v[0], v[1]);
           } else {
-            sort(v.begin(), v.end(), [](auto &left, auto &right) {
-              return left.second < right.second;
-            });
-            vector<int> infos;
-            for(auto p : v) {
-              infos.push_back(p.first);
-            }
-            c.setGateProjection(f, move(infos));
+            c.setGateProjection(f, move(v));
           }
         } else if(type == "monusr" || type == "monusl" || type == "monus") {
           elog(ERROR, "Where-provenance of non-monotone query not supported");
@@ -0,0 +1,40 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE trigger_test(x INT);
+SELECT add_provenance('trigger_test');
+
+CREATE TABLE nb_gates (x INT);
+INSERT INTO nb_gates SELECT get_nb_gates();
+
+INSERT INTO trigger_test SELECT * FROM generate_series(1,5000);
+INSERT INTO trigger_test VALUES (5001);
+
+SELECT get_nb_gates()-x AS nb FROM nb_gates;
+
+SELECT remove_provenance('trigger_test');
+DROP TABLE trigger_test;
+
+CREATE TABLE bulk_test AS SELECT * FROM generate_series(1,5000) AS x;
+UPDATE nb_gates SET x=get_nb_gates();
+SELECT add_provenance('bulk_test', bulk => true);
+INSERT INTO bulk_test VALUES (5001);
+
+SELECT get_nb_gates()-x AS nb FROM nb_gates;
+
+SELECT COUNT(*) AS nb_in_progress FROM stat_progress_add_provenance;
+
+-- Tokens are only registered during a bulk registration, and tokens
+-- buffered by an aborted transaction are discarded
+SELECT register_input_token(public.uuid_generate_v4());
+BEGIN;
+SELECT bulk_input_tokens_start('bulk_test', 1);
+SELECT register_input_token(public.uuid_generate_v5(uuid_ns_provsql(),'aborted')) IS NOT NULL AS registered;
+ROLLBACK;
+SELECT COUNT(*) AS nb_in_progress FROM stat_progress_add_provenance;
+SELECT register_input_token(public.uuid_generate_v4());
+SELECT get_gate_type(public.uuid_generate_v5(uuid_ns_provsql(),'aborted')) IS NULL AS discarded;
+
+SELECT remove_provenance('bulk_test');
+DROP TABLE bulk_test;
+DROP TABLE nb_gates;
@@ -72,5 +72,17 @@ CREATE TABLE banzhaf_result2 AS
 SELECT city, ROUND(value::numeric,3) AS banzhaf FROM banzhaf_result2
 ORDER BY city, banzhaf;
 
+-- Values computed at once, over d-DNNFs with NOT gates over non-input
+-- gates, are those computed one variable at a time
+SELECT city, bool_and(ABS(value-banzhaf(provenance, variable))<1e-9) AS same
+FROM banzhaf_result2
+GROUP BY city
+ORDER BY city;
+
+SELECT city, bool_and(ABS(b.value-banzhaf(provenance, b.variable, 'tree-decomposition'))<1e-9) AS same
+FROM banzhaf_result1, banzhaf_all_vars(provenance, 'tree-decomposition') b
+GROUP BY city
+ORDER BY city;
+
 DROP TABLE banzhaf_result1;
 DROP TABLE banzhaf_result2;
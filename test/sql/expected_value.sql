@@ -0,0 +1,69 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE agg_result AS
+SELECT city, count(*) AS c, sum(id) AS s, sum(id/10.) AS t
+FROM personnel
+GROUP BY city;
+
+SELECT remove_provenance('agg_result');
+
+SELECT city,
+       ROUND(expected_value(c)::numeric,2) AS count,
+       ROUND(expected_value(s)::numeric,2) AS sum
+FROM agg_result
+ORDER BY city;
+
+SELECT count, ROUND(probability::numeric,2) AS probability
+FROM agg_result, count_distribution(c)
+WHERE city='Paris'
+ORDER BY count;
+
+SELECT city,
+       ROUND(probability_evaluate(provenance_cmp(c,'>=',2))::numeric,2) AS count_ge_2,
+       ROUND(probability_evaluate(provenance_cmp(s,'>',5))::numeric,2) AS sum_gt_5
+FROM agg_result
+ORDER BY city;
+
+-- Sums of decimal values are compared exactly: 0.1+0.2=0.3
+SELECT city,
+       ROUND(probability_evaluate(provenance_cmp(t,'=',0.3))::numeric,2) AS tenths_eq_0_3
+FROM agg_result
+ORDER BY city;
+
+-- Only the built-in sum is supported, not an aggregate of the same name
+CREATE AGGREGATE sum(integer) (SFUNC = int4pl, STYPE = integer);
+CREATE TABLE user_sum_result AS
+SELECT city, provsql_test.sum(2*id) AS s FROM personnel GROUP BY city;
+SELECT remove_provenance('user_sum_result');
+
+SELECT city, probability_evaluate(provenance_cmp(s,'>',10)) AS sum_gt_10
+FROM user_sum_result
+WHERE city='Paris';
+SELECT city, expected_value(s) AS sum
+FROM user_sum_result
+WHERE city='Paris';
+
+DROP TABLE user_sum_result;
+DROP AGGREGATE provsql_test.sum(integer);
+
+-- Tuples of a group that share variables
+CREATE TABLE self_join_result AS
+SELECT p1.city, count(*) AS c
+FROM personnel p1, personnel p2
+WHERE p1.city=p2.city AND p1.id<=p2.id
+GROUP BY p1.city;
+
+SELECT remove_provenance('self_join_result');
+
+SELECT city, ROUND(expected_value(c)::numeric,2) AS count
+FROM self_join_result
+ORDER BY city;
+
+SELECT count, ROUND(probability::numeric,2) AS probability
+FROM self_join_result, count_distribution(c)
+WHERE city='Berlin'
+ORDER BY count;
+
+DROP TABLE agg_result;
+DROP TABLE self_join_result;
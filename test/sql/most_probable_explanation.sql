@@ -0,0 +1,77 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE mpe_result AS
+  SELECT p1.city, provenance()
+  FROM personnel p1, personnel p2
+  WHERE p1.city = p2.city AND p1.id < p2.id
+  GROUP BY p1.city;
+SELECT remove_provenance('mpe_result');
+CREATE TABLE mpe_inputs AS
+  SELECT name, provenance() AS provenance FROM personnel;
+SELECT remove_provenance('mpe_inputs');
+
+SELECT city,
+  (SELECT string_agg(name, ',' ORDER BY name) FROM mpe_inputs WHERE provenance = ANY(inputs)) AS explanation,
+  ROUND(probability::numeric,3) AS probability
+FROM mpe_result, most_probable_explanation(provenance)
+ORDER BY city;
+
+-- Top-k explanations, by decreasing probability
+CREATE TABLE topk_result AS
+  SELECT city, provenance() FROM (SELECT DISTINCT city FROM personnel) t
+  WHERE city <> 'Paris';
+SELECT remove_provenance('topk_result');
+
+-- Most probable explanations of a query with DISTINCT
+SELECT city,
+  (SELECT string_agg(name, ',' ORDER BY name) FROM mpe_inputs WHERE provenance = ANY(inputs)) AS explanation,
+  ROUND(probability::numeric,3) AS probability
+FROM topk_result, most_probable_explanation(provenance)
+ORDER BY city;
+
+SELECT city,
+  (SELECT string_agg(name, ',' ORDER BY name) FROM mpe_inputs WHERE provenance = ANY(inputs)) AS explanation,
+  ROUND(probability::numeric,3) AS probability
+FROM topk_result, top_k_explanations(provenance, 5)
+ORDER BY city, probability DESC;
+
+-- Explanations over multivalued inputs, which contain a single
+-- alternative per key
+CREATE TABLE mpe_weather (dummy VARCHAR, weather VARCHAR,
+                ground VARCHAR, p FLOAT);
+INSERT INTO mpe_weather VALUES ('dummy',    'rain', 'wet', 0.35);
+INSERT INTO mpe_weather VALUES ('dummy',    'rain', 'dry', 0.05);
+INSERT INTO mpe_weather VALUES ('dummy', 'no rain', 'wet', 0.1);
+INSERT INTO mpe_weather VALUES ('dummy', 'no rain', 'dry', 0.5);
+
+SELECT repair_key('mpe_weather','dummy');
+DO $$ BEGIN
+  PERFORM set_prob(provenance(), p) FROM mpe_weather;
+END $$;
+
+CREATE TABLE mpe_weather_result AS
+  SELECT ground, provenance() FROM mpe_weather GROUP BY ground;
+SELECT remove_provenance('mpe_weather_result');
+CREATE TABLE mpe_weather_inputs AS
+  SELECT weather, ground, provenance() AS provenance FROM mpe_weather;
+SELECT remove_provenance('mpe_weather_inputs');
+
+SELECT r.ground,
+  (SELECT string_agg(i.weather||'/'||i.ground, ',' ORDER BY i.weather) FROM mpe_weather_inputs i WHERE i.provenance = ANY(inputs)) AS explanation,
+  ROUND(probability::numeric,3) AS probability
+FROM mpe_weather_result r, most_probable_explanation(r.provenance)
+ORDER BY r.ground;
+
+SELECT r.ground,
+  (SELECT string_agg(i.weather||'/'||i.ground, ',' ORDER BY i.weather) FROM mpe_weather_inputs i WHERE i.provenance = ANY(inputs)) AS explanation,
+  ROUND(probability::numeric,3) AS probability
+FROM mpe_weather_result r, top_k_explanations(r.provenance, 5)
+ORDER BY r.ground, probability DESC;
+
+DROP TABLE mpe_weather_result;
+DROP TABLE mpe_weather_inputs;
+DROP TABLE mpe_weather;
+DROP TABLE topk_result;
+DROP TABLE mpe_result;
+DROP TABLE mpe_inputs;
@@ -9,3 +9,18 @@ SELECT remove_provenance('t2');
 SELECT * FROM t2;
 DROP TABLE t;
 DROP TABLE t2;
+
+-- NULL values of aggregated columns
+CREATE TABLE u(x INT);
+INSERT INTO u VALUES(NULL),(1);
+SELECT add_provenance('u');
+CREATE TABLE u2 AS SELECT SUM(x) FROM u;
+SELECT remove_provenance('u2');
+SELECT * FROM u2;
+CREATE TABLE u_name AS SELECT COALESCE(x::text,'null') AS value, provenance() AS provenance FROM u;
+SELECT remove_provenance('u_name');
+-- The NULL value is passed as NULL to the semimodule function
+SELECT aggregation_formula(sum,'u_name') FROM u2;
+DROP TABLE u;
+DROP TABLE u2;
+DROP TABLE u_name;
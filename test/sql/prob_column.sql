@@ -0,0 +1,59 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE scored(id int, confidence double precision);
+INSERT INTO scored VALUES (1,0.1), (2,0.5), (3,NULL);
+SELECT add_provenance('scored', prob_column => 'confidence');
+
+CREATE TABLE scored_result AS
+  SELECT id, ROUND(get_prob(provenance())::numeric,3) AS probability FROM scored;
+SELECT remove_provenance('scored_result');
+SELECT * FROM scored_result ORDER BY id;
+DROP TABLE scored_result;
+
+-- Probabilities follow the column
+INSERT INTO scored VALUES (4,0.7);
+UPDATE scored SET confidence=0.9 WHERE id=1;
+
+CREATE TABLE scored_result AS
+  SELECT id, ROUND(get_prob(provenance())::numeric,3) AS probability FROM scored;
+SELECT remove_provenance('scored_result');
+SELECT * FROM scored_result ORDER BY id;
+DROP TABLE scored_result;
+
+-- Probabilities are only reset by updates of the column
+DO $$ BEGIN
+  PERFORM set_prob(provenance(), 0.3) FROM scored WHERE id=2;
+END $$;
+UPDATE scored SET id=5 WHERE id=2;
+
+CREATE TABLE scored_result AS
+  SELECT id, ROUND(get_prob(provenance())::numeric,3) AS probability FROM scored;
+SELECT remove_provenance('scored_result');
+SELECT * FROM scored_result ORDER BY id;
+DROP TABLE scored_result;
+
+-- Several rows updated by a single statement
+UPDATE scored SET confidence=confidence/3 WHERE id IN (1,4);
+
+CREATE TABLE scored_result AS
+  SELECT id, ROUND(get_prob(provenance())::numeric,3) AS probability FROM scored;
+SELECT remove_provenance('scored_result');
+SELECT * FROM scored_result ORDER BY id;
+DROP TABLE scored_result;
+
+DROP TABLE scored;
+
+-- Columns of other types are converted to double precision
+CREATE TABLE scored_numeric(id int, confidence numeric);
+INSERT INTO scored_numeric VALUES (1,0.25);
+SELECT add_provenance('scored_numeric', prob_column => 'confidence');
+UPDATE scored_numeric SET confidence=0.75;
+
+CREATE TABLE scored_result AS
+  SELECT id, ROUND(get_prob(provenance())::numeric,3) AS probability FROM scored_numeric;
+SELECT remove_provenance('scored_result');
+SELECT * FROM scored_result ORDER BY id;
+DROP TABLE scored_result;
+
+DROP TABLE scored_numeric;
@@ -0,0 +1,27 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE evidence_result AS
+  SELECT city, provenance() FROM (SELECT DISTINCT city FROM personnel) t;
+SELECT remove_provenance('evidence_result');
+CREATE TABLE john AS
+  SELECT provenance() AS provenance FROM personnel WHERE name='John';
+SELECT remove_provenance('john');
+CREATE TABLE dave AS
+  SELECT provenance() AS provenance FROM personnel WHERE name='Dave';
+SELECT remove_provenance('dave');
+
+SELECT city, ROUND(probability_evaluate(provenance, ARRAY(SELECT provenance FROM john))::numeric,3) AS probability
+FROM evidence_result
+ORDER BY city;
+
+-- Negated evidence, on a compiled circuit
+SELECT city, ROUND(probability_evaluate(provenance,
+    ARRAY(SELECT provenance FROM john), ARRAY(SELECT provenance FROM dave),
+    'tree-decomposition')::numeric,3) AS probability
+FROM evidence_result
+ORDER BY city;
+
+DROP TABLE evidence_result;
+DROP TABLE john;
+DROP TABLE dave;
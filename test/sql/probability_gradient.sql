@@ -0,0 +1,14 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE gradient_result1 AS
+  SELECT city, provenance() FROM (SELECT DISTINCT city FROM personnel) t;
+SELECT remove_provenance('gradient_result1');
+CREATE TABLE gradient_result2 AS
+  SELECT * FROM gradient_result1, probability_gradient(provenance);
+
+SELECT city, ROUND(gradient::numeric,3) AS gradient FROM gradient_result2
+ORDER BY city, gradient;
+
+DROP TABLE gradient_result1;
+DROP TABLE gradient_result2;
@@ -0,0 +1,72 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE scenarios AS
+  SELECT 'half'::text AS scenario, provenance() AS provenance, 0.5 AS probability
+  FROM personnel;
+SELECT remove_provenance('scenarios');
+CREATE TABLE john AS
+  SELECT provenance() AS provenance FROM personnel WHERE name='John';
+SELECT remove_provenance('john');
+
+INSERT INTO scenarios
+  SELECT 'double', provenance, LEAST(1, 2*get_prob(provenance)) FROM scenarios;
+INSERT INTO scenarios
+  SELECT 'john', provenance, 1 FROM john;
+
+CREATE TABLE scenarios_result1 AS
+  SELECT city, provenance() FROM (SELECT DISTINCT city FROM personnel) t;
+SELECT remove_provenance('scenarios_result1');
+CREATE TABLE scenarios_result2 AS
+  SELECT * FROM scenarios_result1, probability_evaluate_scenarios(provenance, 'scenarios');
+
+SELECT city, scenario, ROUND(probability::numeric,3) AS probability FROM scenarios_result2
+ORDER BY city, scenario;
+
+-- Scenarios stored in memory
+SELECT load_scenarios('scenarios');
+
+SELECT city, ROUND(probability_evaluate(provenance, NULL, NULL, 'double')::numeric,3) AS probability
+FROM scenarios_result1
+ORDER BY city;
+
+SET provsql.scenario='john';
+SELECT city, ROUND(probability_evaluate(provenance)::numeric,3) AS probability
+FROM scenarios_result1
+ORDER BY city;
+SELECT ROUND(get_prob(provenance)::numeric,3) AS probability FROM john;
+RESET provsql.scenario;
+SELECT ROUND(get_prob(provenance)::numeric,3) AS probability FROM john;
+
+-- Probabilities of multivalued inputs cannot be changed in scenarios
+CREATE TABLE scenarios_weather(dummy VARCHAR, weather VARCHAR);
+INSERT INTO scenarios_weather VALUES ('dummy', 'rain'), ('dummy', 'no rain');
+SELECT repair_key('scenarios_weather', 'dummy');
+CREATE TABLE scenarios_mulinput AS
+  SELECT 'rain'::text AS scenario, provenance() AS provenance, 1 AS probability
+  FROM scenarios_weather WHERE weather='rain';
+SELECT remove_provenance('scenarios_mulinput');
+SELECT p.probability FROM scenarios_mulinput s, probability_evaluate_scenarios(s.provenance, 'scenarios_mulinput') p;
+DROP TABLE scenarios_mulinput;
+DROP TABLE scenarios_weather;
+
+-- Scenarios with an unknown token are rejected as a whole
+SELECT set_scenario_probs('invalid',
+  ARRAY[provenance, public.uuid_generate_v5(uuid_ns_provsql(),'invalid')],
+  ARRAY[0.5, 0.5]) FROM john;
+SELECT probability_evaluate(provenance, NULL, NULL, 'invalid') FROM john;
+
+-- So are scenarios with probabilities outside [0,1]
+SELECT set_scenario_probs('invalid', ARRAY[provenance], ARRAY[1.5]) FROM john;
+SELECT set_scenario_probs('invalid', ARRAY[provenance], ARRAY[-0.5]) FROM john;
+SELECT set_scenario_probs('invalid', ARRAY[provenance], ARRAY['NaN'::double precision]) FROM john;
+SELECT probability_evaluate(provenance, NULL, NULL, 'invalid') FROM john;
+
+DO $$ BEGIN
+  PERFORM drop_scenario(scenario) FROM (SELECT DISTINCT scenario FROM scenarios) t;
+END $$;
+
+DROP TABLE john;
+DROP TABLE scenarios;
+DROP TABLE scenarios_result1;
+DROP TABLE scenarios_result2;
@@ -0,0 +1,60 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE result_builtin AS SELECT
+  p1.city,
+  provenance_evaluate_builtin(provenance(), 'counting', 'personnel_count') AS counting,
+  provenance_evaluate_builtin(provenance(), 'boolean', 'personnel_count') AS boolean,
+  provenance_evaluate_builtin(provenance(), 'formula', 'personnel_name') AS formula,
+  provenance_evaluate_builtin(provenance(), 'why', 'personnel_name') AS why,
+  provenance_evaluate_builtin(provenance(), 'security', 'personnel_level') AS security
+FROM personnel p1, personnel p2
+WHERE p1.city = p2.city AND p1.id < p2.id
+GROUP BY p1.city
+ORDER BY p1.city;
+
+SELECT remove_provenance('result_builtin');
+SELECT * FROM result_builtin;
+
+DROP TABLE result_builtin;
+
+SELECT create_provenance_mapping('personnel_id', 'personnel', 'id');
+SELECT create_provenance_mapping('personnel_tenth', 'personnel', 'id/10.');
+
+CREATE TABLE result_builtin AS SELECT
+  p1.city,
+  provenance_evaluate_builtin(provenance(), 'tropical', 'personnel_id') AS tropical,
+  provenance_evaluate_builtin(provenance(), 'viterbi', 'personnel_tenth') AS viterbi
+FROM personnel p1, personnel p2
+WHERE p1.city = p2.city AND p1.id < p2.id
+GROUP BY p1.city
+ORDER BY p1.city;
+
+SELECT remove_provenance('result_builtin');
+SELECT * FROM result_builtin;
+
+DROP TABLE result_builtin;
+DROP TABLE personnel_id;
+DROP TABLE personnel_tenth;
+
+-- Multivalued inputs are evaluated as plain inputs, to their value in
+-- the mapping
+CREATE TABLE builtin_weather(dummy VARCHAR, weather VARCHAR);
+INSERT INTO builtin_weather VALUES ('dummy', 'rain'), ('dummy', 'no rain');
+SELECT repair_key('builtin_weather', 'dummy');
+SELECT create_provenance_mapping('builtin_weather_name', 'builtin_weather', 'weather');
+
+CREATE TABLE result_builtin AS SELECT
+  dummy,
+  provenance_evaluate_builtin(provenance(), 'counting') AS counting,
+  provenance_evaluate_builtin(provenance(), 'formula', 'builtin_weather_name') AS formula,
+  provenance_evaluate_builtin(provenance(), 'why', 'builtin_weather_name') AS why
+FROM builtin_weather
+GROUP BY dummy;
+
+SELECT remove_provenance('result_builtin');
+SELECT * FROM result_builtin;
+
+DROP TABLE result_builtin;
+DROP TABLE builtin_weather_name;
+DROP TABLE builtin_weather;
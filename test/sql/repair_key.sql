@@ -20,5 +20,23 @@ CREATE TABLE result_repair_key AS
 SELECT remove_provenance('result_repair_key');
 SELECT ground, ROUND(prob::numeric, 3) FROM result_repair_key;
 
+DROP TABLE result_repair_key;
+
+-- Methods other than independent evaluation rewrite multivalued inputs
+-- into independent ones; the self-join puts all alternatives of the key
+-- in the circuit
+CREATE TABLE result_repair_key AS
+  SELECT *,
+    probability_evaluate(provenance(),'possible-worlds') pw,
+    probability_evaluate(provenance(),'tree-decomposition') td FROM (
+    SELECT w1.ground
+    FROM weather_conditions w1, weather_conditions w2
+    WHERE w1.weather = w2.weather
+    GROUP BY w1.ground) t;
+
+SELECT remove_provenance('result_repair_key');
+SELECT ground, ROUND(pw::numeric, 3) pw, ROUND(td::numeric, 3) td
+FROM result_repair_key ORDER BY ground;
+
 DROP TABLE result_repair_key;
 DROP TABLE weather_conditions;
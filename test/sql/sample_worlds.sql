@@ -0,0 +1,61 @@
+\set ECHO none
+SET search_path TO provsql_test,provsql;
+
+CREATE TABLE sample_result AS
+  SELECT city, provenance() FROM (SELECT DISTINCT city FROM personnel) t;
+SELECT remove_provenance('sample_result');
+CREATE TABLE sample_inputs AS
+  SELECT name, city, provenance() AS provenance FROM personnel;
+SELECT remove_provenance('sample_inputs');
+
+-- All sampled worlds satisfy the answer
+SELECT city, COUNT(*) AS samples,
+  bool_and(EXISTS(SELECT 1 FROM sample_inputs i WHERE i.city=r.city AND i.provenance = ANY(w))) AS consistent
+FROM sample_result r, sample_worlds(provenance, 1000, 42) AS w
+GROUP BY city
+ORDER BY city;
+
+-- Samples are reproducible given a seed
+SELECT city,
+  ARRAY(SELECT w::text FROM sample_worlds(provenance, 100, 1) AS w) =
+  ARRAY(SELECT w::text FROM sample_worlds(provenance, 100, 1) AS w) AS reproducible
+FROM sample_result
+ORDER BY city;
+
+-- Frequency of Susan in worlds where Ellen or Susan is true, whose
+-- probability is 0.7/0.82
+SELECT ABS(AVG((i.provenance = ANY(w))::int) - 0.7/0.82) < 0.05 AS frequency
+FROM sample_result r, sample_worlds(r.provenance, 1000, 42) AS w, sample_inputs i
+WHERE r.city='Berlin' AND i.name='Susan';
+
+-- Worlds over multivalued inputs contain a single alternative, rain/wet
+-- being drawn with probability 0.35/0.45 when the ground is wet
+CREATE TABLE sample_weather (dummy VARCHAR, weather VARCHAR,
+                ground VARCHAR, p FLOAT);
+INSERT INTO sample_weather VALUES ('dummy',    'rain', 'wet', 0.35);
+INSERT INTO sample_weather VALUES ('dummy',    'rain', 'dry', 0.05);
+INSERT INTO sample_weather VALUES ('dummy', 'no rain', 'wet', 0.1);
+INSERT INTO sample_weather VALUES ('dummy', 'no rain', 'dry', 0.5);
+
+SELECT repair_key('sample_weather','dummy');
+DO $$ BEGIN
+  PERFORM set_prob(provenance(), p) FROM sample_weather;
+END $$;
+
+CREATE TABLE sample_weather_result AS
+  SELECT ground, provenance() FROM sample_weather GROUP BY ground;
+SELECT remove_provenance('sample_weather_result');
+CREATE TABLE sample_weather_inputs AS
+  SELECT weather, ground, provenance() AS provenance FROM sample_weather;
+SELECT remove_provenance('sample_weather_inputs');
+
+SELECT bool_and(cardinality(w) = 1) AS single,
+  ABS(AVG((i.provenance = ANY(w))::int) - 0.35/0.45) < 0.05 AS frequency
+FROM sample_weather_result r, sample_worlds(r.provenance, 1000, 42) AS w, sample_weather_inputs i
+WHERE r.ground='wet' AND i.weather='rain' AND i.ground='wet';
+
+DROP TABLE sample_weather_result;
+DROP TABLE sample_weather_inputs;
+DROP TABLE sample_weather;
+DROP TABLE sample_result;
+DROP TABLE sample_inputs;
@@ -13,6 +13,8 @@ SELECT DISTINCT ON (city) * FROM personnel;
 
 SELECT DISTINCT 1 FROM personnel GROUP BY city;
 
+SELECT COUNT(*), COUNT(DISTINCT classification) FROM personnel;
+
 SELECT * FROM personnel INTERSECT SELECT * FROM personnel;
 
 SELECT * FROM personnel EXCEPT SELECT * FROM personnel EXCEPT SELECT * FROM personnel;